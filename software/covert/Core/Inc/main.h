@@ -37,6 +37,121 @@ extern "C" {
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+// Cleartext prefix of every encrypted frame. address is a keyed tag naming
+// who the frame is for, so receivers can drop other traffic before the AES.
+// source and sequenceNumber form the AES-GCM nonce, and the whole header is
+// authenticated along with the records.
+typedef struct __attribute__((__packed__)) {
+	uint8_t flags;
+	uint16_t address;
+	uint8_t source;
+	uint32_t sequenceNumber;
+} FrameHeader;
+
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint64_t data;
+	uint8_t ttl;
+	uint8_t playAt;     // network time to start playback, see timesync.h
+} Packet;
+
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint8_t slotOwners[8];
+	uint8_t slotLength;
+	uint8_t slotCount;
+} BeaconPacket;
+
+// A codebook message: the ID of a pre-agreed pattern instead of the raw
+// recording. ttl and playAt sit where they are in a Packet.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint16_t code;
+	uint8_t _placeholder[6];
+	uint8_t ttl;
+	uint8_t playAt;
+} CodePacket;
+
+// Bulk transfer, see bulk.h. The master offers a blob, receivers answer with
+// the chunks they are missing and the master sends those.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint16_t version;
+	uint16_t length;
+	uint32_t crc;
+	uint8_t _placeholder[2];
+} BulkOfferPacket;
+
+// Chunks carry no sequence number, they are tied to one blob by its version
+// and CRC instead and replaying them is harmless.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t index;
+	uint16_t version;
+	uint32_t crc;
+	uint8_t data[8];
+} BulkChunkPacket;
+
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint16_t version;
+	uint64_t missing;
+} BulkStatusPacket;
+
+// Confirms a record from another device: a message the master held for us,
+// or the latest beacon as a sign of life. Carries the group we are in, so
+// others know which of their group messages we should get.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint8_t ackedDevice;
+	uint32_t ackedSequence;
+	uint8_t group;
+	uint8_t _placeholder[4];
+} AckPacket;
+
+// The master's summary of who acknowledged a message, bit n set for device
+// ID n. Like a chunk it has no sequence number, a replay only repeats a fact.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t ackedDevice;
+	uint32_t ackedSequence;
+	uint64_t bitmap;
+	uint8_t _placeholder[2];
+} AckBitmapPacket;
+
+// Sent by the master alongside each beacon: its clock when the previous
+// beacon finished transmitting.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint32_t sequenceNumber;
+	uint32_t beaconSequence;
+	uint32_t beaconTime;
+	uint8_t _placeholder[2];
+} SyncPacket;
+
+// Half of the next epoch's team key, sealed under the current one. The master
+// sends both halves in one frame when it rotates the key.
+typedef struct __attribute__((__packed__)) {
+	uint8_t preamble;
+	uint8_t deviceID;
+	uint8_t epoch;
+	uint8_t half;
+	uint8_t _placeholder[4];
+	uint8_t key[8];
+} RekeyPacket;
 
 /* USER CODE END ET */
 
@@ -56,6 +171,7 @@ void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+uint32_t nextSequenceNumber(void);
 
 /* USER CODE END EFP */
 
@@ -80,6 +196,67 @@ void Error_Handler(void);
 #define LED2_Pin GPIO_PIN_10
 #define LED2_GPIO_Port GPIOC
 /* USER CODE BEGIN Private defines */
+#define MASTER_DEVICE 	0
+#define DEVICE_ID 		1
+
+#define VIBE_PREAMBLE 0b11110000
+#define BEACON_PREAMBLE 0b11001100
+#define SYNC_PREAMBLE 0b11000011
+#define CODE_PREAMBLE 0b11110011
+#define BULK_OFFER_PREAMBLE 0b10011001
+#define BULK_CHUNK_PREAMBLE 0b10010110
+#define BULK_STATUS_PREAMBLE 0b01101001
+#define ACK_PREAMBLE 0b01100110
+#define ACK_BITMAP_PREAMBLE 0b01011010
+#define REKEY_PREAMBLE 0b00001111
+
+// Destinations a frame can be addressed to, and the group this device is in.
+#define ADDRESS_BROADCAST	0
+#define ADDRESS_GROUP		1
+#define ADDRESS_UNICAST		2
+#define ADDRESS_NONE		(-1)
+#define DEVICE_GROUP		1
+
+// Set when some record in the frame still has hops left to be relayed.
+#define FRAME_FLAG_RELAY	0x01
+
+// Bytes of the GCM tag appended to every frame. Frames whose tag does not
+// match are dropped.
+#define FRAME_TAG_LENGTH	4
+
+// Bytes on air of a sealed frame carrying the given number of records.
+#define FRAME_LENGTH(records) \
+	(sizeof(FrameHeader) + (records) * sizeof(Packet) + FRAME_TAG_LENGTH)
+
+// Message priority class, carried in bits 1-2 of the frame header flags and
+// honoured by the TX queue, relays and playback.
+#define PRIORITY_ROUTINE	0
+#define PRIORITY_URGENT		1
+#define PRIORITY_EMERGENCY	2
+
+#define FRAME_PRIORITY_SHIFT	1
+#define FRAME_PRIORITY_MASK		(0x03 << FRAME_PRIORITY_SHIFT)
+#define FRAME_PRIORITY(flags)	(((flags) & FRAME_PRIORITY_MASK) >> FRAME_PRIORITY_SHIFT)
+
+// Epoch of the team key that sealed the frame, bits 4-7 of the flags, see
+// groupkey.h.
+#define FRAME_EPOCH_SHIFT	4
+#define FRAME_EPOCH_MASK	(0x0F << FRAME_EPOCH_SHIFT)
+#define FRAME_EPOCH(flags)	(((flags) & FRAME_EPOCH_MASK) >> FRAME_EPOCH_SHIFT)
+
+// Multi-hop relaying: hop budget stamped on our own packets, and whether this
+// device rebroadcasts packets it hears from others.
+#define RELAY_MODE		1
+#define RELAY_TTL		2
+
+// Slotted access: the master beacons a TX slot schedule to everyone it hears.
+#define TDMA_MODE		1
+
+// Defaults for the settings the master can push over the air, see config.h.
+// Bump CONFIG_VERSION on the master to have it reprogram the team.
+#define CONFIG_VERSION	1
+#define DUTY_CYCLE_ON	10
+#define RECORD_COPIES	3
 
 /* USER CODE END Private defines */
 
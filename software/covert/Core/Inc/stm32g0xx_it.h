@@ -54,7 +54,11 @@ void PendSV_Handler(void);
 void SysTick_Handler(void);
 void EXTI0_1_IRQHandler(void);
 void EXTI4_15_IRQHandler(void);
+void DMA1_Channel1_IRQHandler(void);
+void DMA1_Channel2_3_IRQHandler(void);
+void DMA1_Ch4_7_DMAMUX1_OVR_IRQHandler(void);
 void TIM16_IRQHandler(void);
+void AES_RNG_IRQHandler(void);
 /* USER CODE BEGIN EFP */
 
 /* USER CODE END EFP */
@@ -0,0 +1,267 @@
+#include "ack.h"
+#include "link.h"
+#include "timesync.h"
+
+#include <string.h>
+
+static ack_pending_t pending[ACK_PENDING];
+static ack_tracked_t tracked[ACK_TRACKED];
+static ack_sent_t sent[ACK_SENT];
+
+/**
+ * Private Function Definitions
+ */
+static uint64_t ack_members(uint8_t sender, uint8_t group);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+void ack_init() {
+	memset(pending, 0, sizeof(pending));
+	memset(tracked, 0, sizeof(tracked));
+	memset(sent, 0, sizeof(sent));
+}
+
+/**
+ * Called for every fresh message we take in. A slave schedules its ACK in its
+ * slot, the master counts itself in the message's bitmap straight away.
+ */
+void ack_received(uint8_t sender, uint32_t sequenceNumber) {
+	if (MASTER_DEVICE) {
+		ack_collect(DEVICE_ID, sender, sequenceNumber);
+		return;
+	}
+	for (uint8_t i = 0; i < ACK_PENDING; i++) {
+		if (!pending[i].used) {
+			pending[i].sender = sender;
+			pending[i].sequenceNumber = sequenceNumber;
+			pending[i].due = HAL_GetTick()
+					+ (DEVICE_ID % ACK_SLOTS) * ACK_SLOT_LENGTH;
+			pending[i].used = true;
+			return;
+		}
+	}
+}
+
+/**
+ * Receiver: copies out an acknowledgement whose slot has come
+ */
+bool ack_poll(uint8_t *sender, uint32_t *sequenceNumber) {
+	bool found = false;
+
+	__disable_irq();
+	for (uint8_t i = 0; i < ACK_PENDING; i++) {
+		if (pending[i].used
+				&& (int32_t) (HAL_GetTick() - pending[i].due) >= 0) {
+			*sender = pending[i].sender;
+			*sequenceNumber = pending[i].sequenceNumber;
+			pending[i].used = false;
+			found = true;
+			break;
+		}
+	}
+	__enable_irq();
+
+	return found;
+}
+
+/**
+ * Master: merges an ACK into the bitmap of its message, opening one for a
+ * message not seen before
+ */
+void ack_collect(uint8_t member, uint8_t sender, uint32_t sequenceNumber) {
+	if (!MASTER_DEVICE || member >= ACK_MAX_DEVICES) {
+		return;
+	}
+	ack_tracked_t *entry = NULL;
+	for (uint8_t i = 0; i < ACK_TRACKED; i++) {
+		if (tracked[i].used && tracked[i].sender == sender
+				&& tracked[i].sequenceNumber == sequenceNumber) {
+			entry = &tracked[i];
+			break;
+		}
+		if (!tracked[i].used && !entry) {
+			entry = &tracked[i];
+		}
+	}
+	if (!entry) {
+		return;
+	}
+	if (!entry->used) {
+		// only our own ACK or the sender's message opens a window, a late
+		// ACK for a bitmap already sent would open a useless one
+		if (member != DEVICE_ID) {
+			return;
+		}
+		entry->sender = sender;
+		entry->sequenceNumber = sequenceNumber;
+		entry->bitmap = 0;
+		entry->due = HAL_GetTick() + ACK_WINDOW;
+		entry->used = true;
+	}
+	entry->bitmap |= 1ULL << member;
+}
+
+/**
+ * Master: copies out a bitmap whose window has closed
+ */
+bool ack_pollBitmap(AckBitmapPacket *bitmap) {
+	bool found = false;
+
+	__disable_irq();
+	for (uint8_t i = 0; i < ACK_TRACKED; i++) {
+		if (tracked[i].used
+				&& (int32_t) (HAL_GetTick() - tracked[i].due) >= 0) {
+			memset(bitmap, 0, sizeof(AckBitmapPacket));
+			bitmap->preamble = ACK_BITMAP_PREAMBLE;
+			bitmap->ackedDevice = tracked[i].sender;
+			bitmap->ackedSequence = tracked[i].sequenceNumber;
+			bitmap->bitmap = tracked[i].bitmap;
+			tracked[i].used = false;
+			found = true;
+			break;
+		}
+	}
+	__enable_irq();
+
+	return found;
+}
+
+/**
+ * Sender: remembers a message of ours to group until the master reports who
+ * has it
+ */
+void ack_sent(const Packet *packet, uint8_t priority, uint8_t group) {
+	ack_sent_t *slot = &sent[0];
+	for (uint8_t i = 0; i < ACK_SENT; i++) {
+		if (!sent[i].used) {
+			slot = &sent[i];
+			break;
+		}
+		if ((int32_t) (sent[i].expires - slot->expires) < 0) {
+			slot = &sent[i];
+		}
+	}
+	memcpy(&slot->packet, packet, sizeof(Packet));
+	slot->priority = priority;
+	slot->group = group;
+	slot->resend = 0;
+	slot->expires = HAL_GetTick() + (ACK_MAX_TRIES + 1) * 2 * ACK_WINDOW;
+	slot->tries = 0;
+	slot->used = true;
+
+	// on the master our own message opens its bitmap directly
+	ack_collect(DEVICE_ID, DEVICE_ID, packet->sequenceNumber);
+}
+
+/**
+ * Sender: compares the master's bitmap with the members of the message's
+ * group we heard lately and schedules the message again for those missing
+ * from it. Who got the original copies feeds each member's link loss.
+ */
+void ack_receiveBitmap(const AckBitmapPacket *bitmap) {
+	if (bitmap->ackedDevice != DEVICE_ID) {
+		return;
+	}
+	for (uint8_t i = 0; i < ACK_SENT; i++) {
+		ack_sent_t *entry = &sent[i];
+		if (!entry->used
+				|| entry->packet.sequenceNumber != bitmap->ackedSequence) {
+			continue;
+		}
+		uint64_t members = ack_members(DEVICE_ID, entry->group);
+		uint64_t missing = members & ~bitmap->bitmap;
+		// the first bitmap tells how the original copies fared, later ones
+		// only how the resends did
+		if (entry->tries == 0) {
+			for (uint8_t id = 0; id < ACK_MAX_DEVICES; id++) {
+				if ((members >> id) & 1) {
+					link_delivery(id, !((missing >> id) & 1));
+				}
+			}
+		}
+		if (!missing || entry->tries >= ACK_MAX_TRIES) {
+			entry->used = false;
+		} else {
+			entry->resend = missing;
+			entry->tries++;
+		}
+		return;
+	}
+}
+
+/**
+ * Sender: copies out the next retransmission, to one member or, when too
+ * many missed it, to the whole group
+ */
+bool ack_pollResend(Packet *packet, int16_t *peer, uint8_t *priority) {
+	bool found = false;
+	uint32_t now = HAL_GetTick();
+
+	__disable_irq();
+	for (uint8_t i = 0; i < ACK_SENT && !found; i++) {
+		ack_sent_t *entry = &sent[i];
+		if (!entry->used) {
+			continue;
+		}
+		if ((int32_t) (now - entry->expires) >= 0) {
+			entry->used = false;
+			continue;
+		}
+		if (!entry->resend) {
+			continue;
+		}
+
+		uint8_t count = 0;
+		uint8_t first = 0;
+		for (uint8_t id = ACK_MAX_DEVICES; id-- > 0;) {
+			if ((entry->resend >> id) & 1) {
+				count++;
+				first = id;
+			}
+		}
+		if (count > ACK_UNICAST_MAX) {
+			*peer = ACK_RESEND_GROUP;
+			entry->resend = 0;
+		} else {
+			*peer = first;
+			entry->resend &= ~(1ULL << first);
+		}
+		memcpy(packet, &entry->packet, sizeof(Packet));
+		// the original target has passed, play on arrival
+		packet->playAt = TIMESYNC_NO_TARGET;
+		*priority = entry->priority;
+		found = true;
+	}
+	__enable_irq();
+
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * Members of the group we heard recently enough to expect an ACK from, as a
+ * bitmap. Devices whose group we don't know yet can't be expected to have
+ * opened the message.
+ */
+static uint64_t ack_members(uint8_t sender, uint8_t group) {
+	uint64_t members = 0;
+	uint32_t now = HAL_GetTick();
+
+	for (uint8_t id = 0; id < ACK_MAX_DEVICES; id++) {
+		const link_peer_t *peer = link_peer(id);
+		if (id != sender && peer && now - peer->lastSeen < LINK_STALE
+				&& link_inGroup(id, group)) {
+			members |= 1ULL << id;
+		}
+	}
+	return members;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+#include "airtime.h"
+
+// Receivers answer a message in a slot picked by their device ID, so the
+// acknowledgements of a whole team do not collide.
+#ifndef ACK_SLOTS
+#define ACK_SLOTS 16
+#endif
+
+// Radio turnaround and channel check between two slots, in ms.
+#ifndef ACK_TURNAROUND
+#define ACK_TURNAROUND 20
+#endif
+
+// One frame carrying a lone ACK on air plus turnaround, in ms.
+#ifndef ACK_SLOT_LENGTH
+#define ACK_SLOT_LENGTH \
+	((airtime_frame(FRAME_LENGTH(1)) + 999) / 1000 + ACK_TURNAROUND)
+#endif
+
+// Master: how long ACKs for a message are merged before the bitmap goes out,
+// every slot and a second for stragglers.
+#ifndef ACK_WINDOW
+#define ACK_WINDOW (ACK_SLOTS * ACK_SLOT_LENGTH + 1000)
+#endif
+
+// Sender: rounds of selective retransmission before we leave the rest to the
+// master's store-and-forward.
+#ifndef ACK_MAX_TRIES
+#define ACK_MAX_TRIES 2
+#endif
+
+// Missing members up to this many get the message unicast, more get it
+// resent to the group.
+#ifndef ACK_UNICAST_MAX
+#define ACK_UNICAST_MAX 2
+#endif
+
+// Acknowledgements pending at a receiver, messages merged on the master and
+// messages awaiting a bitmap at the sender.
+#ifndef ACK_PENDING
+#define ACK_PENDING 8
+#endif
+
+#ifndef ACK_TRACKED
+#define ACK_TRACKED 4
+#endif
+
+#ifndef ACK_SENT
+#define ACK_SENT 4
+#endif
+
+// Device IDs that fit the bitmap.
+#define ACK_MAX_DEVICES 64
+
+// peer value ack_pollResend returns for a resend to the whole group.
+#define ACK_RESEND_GROUP -1
+
+
+/**
+ * Receiver: a record to acknowledge once our slot comes up.
+ */
+typedef struct {
+	uint8_t sender;
+	uint32_t sequenceNumber;
+	uint32_t due;
+	bool used;
+} ack_pending_t;
+
+/**
+ * Master: who acknowledged a message so far.
+ */
+typedef struct {
+	uint8_t sender;
+	uint32_t sequenceNumber;
+	uint64_t bitmap;
+	uint32_t due;
+	bool used;
+} ack_tracked_t;
+
+/**
+ * Sender: a message of ours, the group it went to and the members it still
+ * has to reach.
+ */
+typedef struct {
+	Packet packet;
+	uint8_t priority;
+	uint8_t group;
+	uint64_t resend;
+	uint32_t expires;
+	uint8_t tries;
+	bool used;
+} ack_sent_t;
+
+
+/**
+ *  Global Functions
+ */
+void ack_init();
+void ack_received(uint8_t sender, uint32_t sequenceNumber);
+bool ack_poll(uint8_t *sender, uint32_t *sequenceNumber);
+void ack_collect(uint8_t member, uint8_t sender, uint32_t sequenceNumber);
+bool ack_pollBitmap(AckBitmapPacket *bitmap);
+void ack_sent(const Packet *packet, uint8_t priority, uint8_t group);
+void ack_receiveBitmap(const AckBitmapPacket *bitmap);
+bool ack_pollResend(Packet *packet, int16_t *peer, uint8_t *priority);
@@ -0,0 +1,116 @@
+#include "airtime.h"
+
+#include <string.h>
+
+// per class us of airtime per ms, the device's bucket last
+#define AIRTIME_CLASS_RATE(share) (AIRTIME_RATE_TOTAL * (share) / 1000)
+static const uint16_t rates[AIRTIME_CLASSES + 1] = {
+		AIRTIME_CLASS_RATE(AIRTIME_SHARE_ROUTINE),
+		AIRTIME_CLASS_RATE(AIRTIME_SHARE_URGENT),
+		AIRTIME_CLASS_RATE(AIRTIME_SHARE_EMERGENCY),
+		AIRTIME_CLASS_RATE(AIRTIME_SHARE_CONTROL), AIRTIME_RATE_TOTAL };
+static const uint16_t bursts[AIRTIME_CLASSES + 1] = { AIRTIME_BURST_ROUTINE,
+		AIRTIME_BURST_URGENT, AIRTIME_BURST_EMERGENCY, AIRTIME_BURST_CONTROL,
+		AIRTIME_BURST_TOTAL };
+
+static airtime_bucket_t buckets[AIRTIME_CLASSES + 1];
+
+/**
+ * Private Function Definitions
+ */
+static void airtime_refill(airtime_class_t class);
+static uint32_t airtime_missing(airtime_class_t class, uint32_t needed);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Starts every bucket full
+ */
+void airtime_init() {
+	for (uint8_t i = 0; i <= AIRTIME_TOTAL; i++) {
+		buckets[i].tokens = bursts[i] * 1000;
+		buckets[i].refilled = HAL_GetTick();
+	}
+}
+
+/**
+ * Time on air of a frame of length bytes in us, from the formula in the
+ * SX1276 datasheet
+ */
+uint32_t airtime_frame(uint8_t length) {
+	uint32_t symbol = ((1UL << AIRTIME_SF) * 1000000UL) / (AIRTIME_BW / 1000)
+			/ 1000;
+	// preamble is 4.25 symbols longer than programmed, kept in quarters
+	uint32_t preamble = (AIRTIME_PREAMBLE * 4 + 17) * symbol / 4;
+
+	int32_t bits = 8 * length - 4 * AIRTIME_SF + 28 + 16 * AIRTIME_CRC
+			- 20 * AIRTIME_IMPLICIT;
+	int32_t perBlock = 4 * (AIRTIME_SF - 2 * AIRTIME_LDRO);
+	uint32_t blocks = bits > 0 ? (bits + perBlock - 1) / perBlock : 0;
+	uint32_t payload = 8 + blocks * (AIRTIME_CR + 4);
+
+	return preamble + payload * symbol;
+}
+
+/**
+ * How long in ms a frame of the class has to wait for its budget and the
+ * device's, 0 if it may go now
+ */
+uint32_t airtime_wait(airtime_class_t class, uint8_t length) {
+	uint32_t needed = airtime_frame(length);
+	uint32_t wait = airtime_missing(class, needed);
+	uint32_t total = airtime_missing(AIRTIME_TOTAL, needed);
+
+	return total > wait ? total : wait;
+}
+
+/**
+ * Takes a transmitted frame's airtime out of the class's bucket and the
+ * device's
+ */
+void airtime_charge(airtime_class_t class, uint8_t length) {
+	uint32_t used = airtime_frame(length);
+
+	airtime_refill(class);
+	buckets[class].tokens -= used;
+	airtime_refill(AIRTIME_TOTAL);
+	buckets[AIRTIME_TOTAL].tokens -= used;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static void airtime_refill(airtime_class_t class) {
+	uint32_t now = HAL_GetTick();
+	uint32_t elapsed = now - buckets[class].refilled;
+	int32_t capacity = bursts[class] * 1000;
+
+	buckets[class].refilled = now;
+	if (elapsed > (uint32_t) capacity / rates[class]) {
+		buckets[class].tokens = capacity;
+		return;
+	}
+	buckets[class].tokens += elapsed * rates[class];
+	if (buckets[class].tokens > capacity) {
+		buckets[class].tokens = capacity;
+	}
+}
+
+/**
+ * ms until a bucket holds needed us, refilling at rate us per ms
+ */
+static uint32_t airtime_missing(airtime_class_t class, uint32_t needed) {
+	airtime_refill(class);
+	int32_t missing = needed - buckets[class].tokens;
+	if (missing <= 0) {
+		return 0;
+	}
+	return (missing + rates[class] - 1) / rates[class];
+}
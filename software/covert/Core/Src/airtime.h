@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Modem settings the time on air is computed for, as set up in rfm95_init.
+#define AIRTIME_SF 9
+#define AIRTIME_BW 250000
+#define AIRTIME_CR 1          // coding rate 4/(4 + CR)
+#define AIRTIME_PREAMBLE 8
+#define AIRTIME_CRC 1
+#define AIRTIME_IMPLICIT 0
+#define AIRTIME_LDRO 0
+
+// Budget of the whole device: share of time we may spend transmitting, in
+// per mille, and the burst allowed on top of it, in ms of airtime. Every frame
+// is charged here as well as to its class.
+#ifndef AIRTIME_RATE_TOTAL
+#define AIRTIME_RATE_TOTAL 250
+#endif
+#ifndef AIRTIME_BURST_TOTAL
+#define AIRTIME_BURST_TOTAL 4000
+#endif
+
+// Budget per class: its share of the device's rate, in per mille of it, and
+// the burst allowed on top of it, in ms of airtime. Shares may add up to more
+// than the whole, the device's bucket caps them together.
+#ifndef AIRTIME_SHARE_CONTROL
+#define AIRTIME_SHARE_CONTROL 500
+#endif
+#ifndef AIRTIME_BURST_CONTROL
+#define AIRTIME_BURST_CONTROL 2000
+#endif
+
+#ifndef AIRTIME_SHARE_ROUTINE
+#define AIRTIME_SHARE_ROUTINE 400
+#endif
+#ifndef AIRTIME_BURST_ROUTINE
+#define AIRTIME_BURST_ROUTINE 1500
+#endif
+
+#ifndef AIRTIME_SHARE_URGENT
+#define AIRTIME_SHARE_URGENT 800
+#endif
+#ifndef AIRTIME_BURST_URGENT
+#define AIRTIME_BURST_URGENT 2000
+#endif
+
+#ifndef AIRTIME_SHARE_EMERGENCY
+#define AIRTIME_SHARE_EMERGENCY 1000
+#endif
+#ifndef AIRTIME_BURST_EMERGENCY
+#define AIRTIME_BURST_EMERGENCY 3000
+#endif
+
+// A frame that would be held longer than this since it was queued, waiting
+// for its budget or a clear channel, is shed, in ms.
+#ifndef AIRTIME_MAX_DEFER
+#define AIRTIME_MAX_DEFER 5000
+#endif
+
+
+/**
+ * What a frame is charged to. Messages use their priority class, the
+ * protocol's own traffic has a bucket of its own.
+ */
+typedef enum
+{
+	AIRTIME_ROUTINE = PRIORITY_ROUTINE,
+	AIRTIME_URGENT = PRIORITY_URGENT,
+	AIRTIME_EMERGENCY = PRIORITY_EMERGENCY,
+	AIRTIME_CONTROL,     // Beacons, pairing and key exchange.
+	AIRTIME_CLASSES,
+	AIRTIME_TOTAL = AIRTIME_CLASSES   // The whole device, not a class.
+} airtime_class_t;
+
+typedef struct {
+	int32_t tokens;      // us of airtime left
+	uint32_t refilled;
+} airtime_bucket_t;
+
+
+/**
+ *  Global Functions
+ */
+void airtime_init();
+uint32_t airtime_frame(uint8_t length);
+uint32_t airtime_wait(airtime_class_t class, uint8_t length);
+void airtime_charge(airtime_class_t class, uint8_t length);
@@ -0,0 +1,329 @@
+#include "bulk.h"
+#include "config.h"
+
+#include <string.h>
+
+// The blob being offered (master) or reassembled (slave). Word aligned for
+// the CRC unit.
+static uint32_t buffer[BULK_MAX_LENGTH / sizeof(uint32_t)];
+static uint16_t length = 0;
+static uint16_t version = 0;
+static uint32_t crc = 0;
+static uint8_t chunkCount = 0;
+
+// Master: union of the chunks receivers reported missing, and per group the
+// most any single receiver is missing. A group everyone is missing only a few
+// of is repaired with parity, one parity chunk fixes a different loss at
+// every receiver.
+static volatile uint64_t missing = 0;
+static volatile uint8_t need[BULK_GROUPS];
+static uint8_t nextRow[BULK_GROUPS];
+static bool sourceValid = false;
+static bulk_state_t state = BULK_IDLE;
+static uint32_t deadline = 0;
+static uint8_t plan[BULK_WINDOW];
+static uint8_t planCount = 0;
+static uint8_t planNext = 0;
+
+// Slave: chunks of the current blob we hold. Kept across offers of the same
+// blob so an interrupted transfer resumes where it stopped.
+static volatile uint64_t received = 0;
+static volatile bool active = false;
+static volatile bool complete = false;
+static uint8_t parity[BULK_GROUPS][FEC_MAX_ROWS * BULK_CHUNK_SIZE];
+static uint8_t parityRows[BULK_GROUPS];
+
+/**
+ * Private Function Definitions
+ */
+static uint64_t bulk_mask(uint8_t chunks);
+static uint8_t bulk_groupSize(uint8_t group);
+static uint8_t bulk_count(uint8_t bits);
+static void bulk_plan();
+static void bulk_repair(uint8_t group);
+static void bulk_buildOffer(Packet *record);
+static void bulk_buildChunk(Packet *record, uint8_t index);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+void bulk_init() {
+	fec_init();
+	sourceValid = false;
+	state = BULK_IDLE;
+	missing = 0;
+	received = 0;
+	active = false;
+	complete = false;
+}
+
+/**
+ * Master side: sets the blob offered to the team
+ */
+void bulk_source(const void *blob, uint16_t blobLength, uint16_t blobVersion) {
+	if (blobLength == 0 || blobLength > BULK_MAX_LENGTH) {
+		return;
+	}
+	memset(buffer, 0, sizeof(buffer));
+	memcpy(buffer, blob, blobLength);
+	length = blobLength;
+	version = blobVersion;
+	crc = config_crc(buffer, length);
+	chunkCount = (length + BULK_CHUNK_SIZE - 1) / BULK_CHUNK_SIZE;
+
+	memset(nextRow, 0, sizeof(nextRow));
+	sourceValid = true;
+	state = BULK_IDLE;
+	deadline = HAL_GetTick() + BULK_STATUS_WAIT;
+}
+
+/**
+ * Master side: returns the next offer or chunk to send, if any. An offer
+ * collects missing-chunk bitmaps for a while, then up to BULK_WINDOW data or
+ * parity chunks repairing them go out and the next offer asks again what is
+ * still missing.
+ */
+bool bulk_poll(Packet *record) {
+	if (!MASTER_DEVICE || !sourceValid) {
+		return false;
+	}
+	uint32_t now = HAL_GetTick();
+
+	switch (state) {
+	case BULK_IDLE:
+		if ((int32_t) (now - deadline) < 0) {
+			return false;
+		}
+		break;
+	case BULK_COLLECT:
+		if ((int32_t) (now - deadline) < 0) {
+			return false;
+		}
+		if (!missing) {
+			state = BULK_IDLE;
+			deadline = now + BULK_OFFER_INTERVAL;
+			return false;
+		}
+		bulk_plan();
+		state = BULK_SEND;
+		/* no break */
+	case BULK_SEND:
+		if (planNext < planCount) {
+			bulk_buildChunk(record, plan[planNext++]);
+			return true;
+		}
+		break;
+	}
+
+	__disable_irq();
+	missing = 0;
+	memset((uint8_t*) need, 0, sizeof(need));
+	__enable_irq();
+	bulk_buildOffer(record);
+	state = BULK_COLLECT;
+	deadline = now + BULK_STATUS_WAIT;
+	return true;
+}
+
+/**
+ * Handles a decrypted bulk record, called on RX done. Returns true with the
+ * status to send back in reply when an offer is for a blob we still need.
+ */
+bool bulk_receive(const Packet *record, Packet *reply) {
+	if (record->preamble == BULK_STATUS_PREAMBLE) {
+		const BulkStatusPacket *status = (const BulkStatusPacket*) record;
+		if (MASTER_DEVICE && sourceValid && status->version == version) {
+			uint64_t gaps = status->missing & bulk_mask(chunkCount);
+			missing |= gaps;
+			for (uint8_t g = 0; g < BULK_GROUPS; g++) {
+				uint8_t count = bulk_count(gaps >> (g * FEC_MAX_K));
+				if (count > need[g]) {
+					need[g] = count;
+				}
+			}
+		}
+		return false;
+	}
+	if (MASTER_DEVICE || complete) {
+		return false;
+	}
+
+	if (record->preamble == BULK_OFFER_PREAMBLE) {
+		const BulkOfferPacket *offer = (const BulkOfferPacket*) record;
+		if (offer->version <= config_version() || offer->length == 0
+				|| offer->length > BULK_MAX_LENGTH) {
+			return false;
+		}
+		if (!active || offer->version != version || offer->crc != crc) {
+			version = offer->version;
+			crc = offer->crc;
+			length = offer->length;
+			chunkCount = (length + BULK_CHUNK_SIZE - 1) / BULK_CHUNK_SIZE;
+			received = 0;
+			memset(parityRows, 0, sizeof(parityRows));
+			active = true;
+		}
+
+		BulkStatusPacket status;
+		memset(&status, 0, sizeof(status));
+		status.preamble = BULK_STATUS_PREAMBLE;
+		status.deviceID = DEVICE_ID;
+		status.sequenceNumber = nextSequenceNumber();
+		status.version = version;
+		status.missing = ~received & bulk_mask(chunkCount);
+		memcpy(reply, &status, sizeof(Packet));
+		return true;
+
+	} else if (record->preamble == BULK_CHUNK_PREAMBLE) {
+		const BulkChunkPacket *chunk = (const BulkChunkPacket*) record;
+		if (!active || chunk->version != version || chunk->crc != crc) {
+			return false;
+		}
+		uint8_t group;
+		if (chunk->index < chunkCount) {
+			memcpy((uint8_t*) buffer + chunk->index * BULK_CHUNK_SIZE,
+					chunk->data, BULK_CHUNK_SIZE);
+			received |= 1ULL << chunk->index;
+			group = chunk->index / FEC_MAX_K;
+		} else if (chunk->index >= BULK_PARITY_BASE
+				&& chunk->index - BULK_PARITY_BASE
+						< BULK_GROUPS * FEC_MAX_ROWS) {
+			group = (chunk->index - BULK_PARITY_BASE) / FEC_MAX_ROWS;
+			uint8_t row = (chunk->index - BULK_PARITY_BASE) % FEC_MAX_ROWS;
+			memcpy(parity[group] + row * BULK_CHUNK_SIZE, chunk->data,
+					BULK_CHUNK_SIZE);
+			parityRows[group] |= 1 << row;
+		} else {
+			return false;
+		}
+		bulk_repair(group);
+		if (received == bulk_mask(chunkCount)) {
+			complete = true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Slave side, from the main loop: commits a fully received blob, which also
+ * checks its CRC. Returns true if a new config is now in use.
+ */
+bool bulk_process() {
+	if (!complete) {
+		return false;
+	}
+	bool committed = config_commit((uint8_t*) buffer, length, version, crc);
+	active = false;
+	complete = false;
+	return committed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static uint64_t bulk_mask(uint8_t chunks) {
+	return chunks >= BULK_MAX_CHUNKS ? UINT64_MAX : (1ULL << chunks) - 1;
+}
+
+static uint8_t bulk_groupSize(uint8_t group) {
+	uint8_t first = group * FEC_MAX_K;
+	if (first >= chunkCount) {
+		return 0;
+	}
+	return chunkCount - first < FEC_MAX_K ? chunkCount - first : FEC_MAX_K;
+}
+
+static uint8_t bulk_count(uint8_t bits) {
+	uint8_t count = 0;
+	for (; bits; bits &= bits - 1) {
+		count++;
+	}
+	return count;
+}
+
+/**
+ * Master side: picks the chunks for the next window. A group where somebody
+ * misses more than the parity rows can cover gets its missing data chunks
+ * again, otherwise as many fresh parity rows as the worst receiver needs.
+ */
+static void bulk_plan() {
+	planCount = 0;
+	planNext = 0;
+
+	__disable_irq();
+	for (uint8_t g = 0; g < BULK_GROUPS && planCount < BULK_WINDOW; g++) {
+		if (need[g] == 0) {
+			continue;
+		}
+		if (need[g] > FEC_MAX_ROWS) {
+			for (uint8_t i = 0; i < bulk_groupSize(g) && planCount < BULK_WINDOW;
+					i++) {
+				uint8_t index = g * FEC_MAX_K + i;
+				if ((missing >> index) & 1) {
+					plan[planCount++] = index;
+				}
+			}
+		} else {
+			for (uint8_t i = 0; i < need[g] && planCount < BULK_WINDOW; i++) {
+				plan[planCount++] = BULK_PARITY_BASE + g * FEC_MAX_ROWS
+						+ nextRow[g];
+				nextRow[g] = (nextRow[g] + 1) % FEC_MAX_ROWS;
+			}
+		}
+	}
+	__enable_irq();
+}
+
+/**
+ * Slave side: rebuilds the missing data chunks of a group once we hold as many
+ * parity chunks for it as it is missing
+ */
+static void bulk_repair(uint8_t group) {
+	uint8_t k = bulk_groupSize(group);
+	uint8_t present = (received >> (group * FEC_MAX_K)) & ((1 << k) - 1);
+	uint8_t absent = k - bulk_count(present);
+
+	if (absent == 0 || absent > bulk_count(parityRows[group])) {
+		return;
+	}
+	if (fec_decode((uint8_t*) buffer + group * FEC_MAX_K * BULK_CHUNK_SIZE, k,
+			present, parity[group], parityRows[group], BULK_CHUNK_SIZE)) {
+		received |= (uint64_t) ((1 << k) - 1) << (group * FEC_MAX_K);
+	}
+}
+
+static void bulk_buildOffer(Packet *record) {
+	BulkOfferPacket offer;
+	memset(&offer, 0, sizeof(offer));
+	offer.preamble = BULK_OFFER_PREAMBLE;
+	offer.deviceID = DEVICE_ID;
+	offer.sequenceNumber = nextSequenceNumber();
+	offer.version = version;
+	offer.length = length;
+	offer.crc = crc;
+	memcpy(record, &offer, sizeof(Packet));
+}
+
+static void bulk_buildChunk(Packet *record, uint8_t index) {
+	BulkChunkPacket chunk;
+	chunk.preamble = BULK_CHUNK_PREAMBLE;
+	chunk.index = index;
+	chunk.version = version;
+	chunk.crc = crc;
+	if (index < BULK_PARITY_BASE) {
+		memcpy(chunk.data, (uint8_t*) buffer + index * BULK_CHUNK_SIZE,
+				BULK_CHUNK_SIZE);
+	} else {
+		uint8_t group = (index - BULK_PARITY_BASE) / FEC_MAX_ROWS;
+		uint8_t row = (index - BULK_PARITY_BASE) % FEC_MAX_ROWS;
+		fec_encode((uint8_t*) buffer + group * FEC_MAX_K * BULK_CHUNK_SIZE,
+				bulk_groupSize(group), row, BULK_CHUNK_SIZE, chunk.data);
+	}
+	memcpy(record, &chunk, sizeof(Packet));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+#include "fec.h"
+
+#define BULK_CHUNK_SIZE 8
+
+// The receive bitmap is a uint64_t, so a blob spans at most 64 chunks.
+#define BULK_MAX_CHUNKS 64
+#define BULK_MAX_LENGTH (BULK_CHUNK_SIZE * BULK_MAX_CHUNKS)
+
+// Chunks are erasure coded in groups of FEC_MAX_K. Parity chunks follow the
+// data chunks in the index space, FEC_MAX_ROWS per group.
+#define BULK_GROUPS (BULK_MAX_CHUNKS / FEC_MAX_K)
+#define BULK_PARITY_BASE BULK_MAX_CHUNKS
+
+// Chunks the master sends before offering again to collect fresh bitmaps.
+#ifndef BULK_WINDOW
+#define BULK_WINDOW 16
+#endif
+
+// How long the master listens for status replies after an offer, in ms.
+#ifndef BULK_STATUS_WAIT
+#define BULK_STATUS_WAIT 3000
+#endif
+
+// Pause between offers once nobody is missing anything, in ms.
+#ifndef BULK_OFFER_INTERVAL
+#define BULK_OFFER_INTERVAL 30000
+#endif
+
+
+/**
+ * Master side progress through an offer round.
+ */
+typedef enum
+{
+	BULK_IDLE = 0,      // Waiting for the next periodic offer.
+	BULK_COLLECT = 1,   // Offer sent, merging the status replies.
+	BULK_SEND = 2,      // Sending the chunks somebody is missing.
+} bulk_state_t;
+
+
+/**
+ *  Global Functions
+ */
+void bulk_init();
+void bulk_source(const void *blob, uint16_t length, uint16_t version);
+bool bulk_poll(Packet *record);
+bool bulk_receive(const Packet *record, Packet *reply);
+bool bulk_process();
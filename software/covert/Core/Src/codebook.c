@@ -0,0 +1,144 @@
+#include "codebook.h"
+
+#include <string.h>
+
+// Codes every device knows out of the box, the ID is the index.
+static const codebook_entry_t defaults[] = {
+	{ 1, 0b0000, PRIORITY_ROUTINE },    // .     acknowledge
+	{ 2, 0b0000, PRIORITY_ROUTINE },    // ..    hold
+	{ 3, 0b0000, PRIORITY_ROUTINE },    // ...   move
+	{ 1, 0b0001, PRIORITY_ROUTINE },    // -     negative
+	{ 2, 0b0001, PRIORITY_ROUTINE },    // -.    regroup
+	{ 3, 0b0001, PRIORITY_URGENT },     // -..   contact
+	{ 3, 0b0010, PRIORITY_URGENT },     // .-.   abort
+	{ 3, 0b0111, PRIORITY_EMERGENCY },  // ---   assistance
+};
+
+static codebook_entry_t codebook[CODEBOOK_SIZE];
+static uint8_t codebookCount = 0;
+
+/**
+ * Private Function Definitions
+ */
+static uint8_t codebook_put(uint64_t *pattern, uint8_t at, uint8_t length);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Loads the built in codes
+ */
+void codebook_init() {
+	memset(codebook, 0, sizeof(codebook));
+	memcpy(codebook, defaults, sizeof(defaults));
+	codebookCount = sizeof(defaults) / sizeof(defaults[0]);
+}
+
+/**
+ * Replaces the codebook, e.g. with one pushed by the master
+ */
+void codebook_load(const codebook_entry_t *entries, uint8_t count) {
+	if (count > CODEBOOK_SIZE) {
+		count = CODEBOOK_SIZE;
+	}
+	__disable_irq();
+	memset(codebook, 0, sizeof(codebook));
+	memcpy(codebook, entries, count * sizeof(codebook_entry_t));
+	codebookCount = count;
+	__enable_irq();
+}
+
+/**
+ * Copies out the codebook in use, returns the number of entries
+ */
+uint8_t codebook_copy(codebook_entry_t *entries) {
+	memcpy(entries, codebook, codebookCount * sizeof(codebook_entry_t));
+	return codebookCount;
+}
+
+/**
+ * Looks a recording of count ticks up in the codebook. Only answers once the
+ * button has been up for CODEBOOK_END_GAP ticks, so a code can go out as soon
+ * as it is complete instead of after the whole recording window. Returns the
+ * code ID, or CODEBOOK_NO_MATCH.
+ */
+int16_t codebook_match(uint64_t data, uint8_t count) {
+	if (count <= CODEBOOK_END_GAP || count > sizeof(data) * 8) {
+		return CODEBOOK_NO_MATCH;
+	}
+	if ((data >> (count - CODEBOOK_END_GAP))
+			& ((1ULL << CODEBOOK_END_GAP) - 1)) {
+		return CODEBOOK_NO_MATCH;
+	}
+
+	uint8_t symbols = 0;
+	uint8_t dashes = 0;
+	uint8_t run = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		if ((data >> i) & 1) {
+			run++;
+		} else if (run) {
+			if (symbols == CODEBOOK_MAX_SYMBOLS) {
+				return CODEBOOK_NO_MATCH;
+			}
+			if (run >= CODEBOOK_DASH_TICKS) {
+				dashes |= 1 << symbols;
+			}
+			symbols++;
+			run = 0;
+		}
+	}
+
+	for (uint8_t i = 0; i < codebookCount; i++) {
+		if (codebook[i].symbols == symbols && codebook[i].dashes == dashes) {
+			return i;
+		}
+	}
+	return CODEBOOK_NO_MATCH;
+}
+
+/**
+ * Expands a code ID to the canonical pattern played by the receiver. Returns
+ * false for a code this device does not know.
+ */
+bool codebook_render(uint16_t code, uint64_t *pattern) {
+	if (code >= codebookCount || codebook[code].symbols == 0) {
+		return false;
+	}
+
+	*pattern = 0;
+	uint8_t at = 0;
+	for (uint8_t i = 0; i < codebook[code].symbols; i++) {
+		bool dash = (codebook[code].dashes >> i) & 1;
+		at = codebook_put(pattern, at,
+				dash ? CODEBOOK_DASH_LENGTH : CODEBOOK_DOT_LENGTH);
+		at += CODEBOOK_GAP_LENGTH;
+	}
+	return true;
+}
+
+/**
+ * Class a code is sent with at least
+ */
+uint8_t codebook_priority(uint16_t code) {
+	return code < codebookCount ? codebook[code].priority : PRIORITY_ROUTINE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * Sets length bits of the pattern starting at bit at, as far as it reaches
+ */
+static uint8_t codebook_put(uint64_t *pattern, uint8_t at, uint8_t length) {
+	for (uint8_t i = 0; i < length && at < sizeof(*pattern) * 8; i++) {
+		*pattern |= 1ULL << at++;
+	}
+	return at;
+}
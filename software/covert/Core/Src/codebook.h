@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+#ifndef CODEBOOK_SIZE
+#define CODEBOOK_SIZE 16
+#endif
+
+// Presses per code. Four dashes and their gaps still fit one 64 tick pattern.
+#ifndef CODEBOOK_MAX_SYMBOLS
+#define CODEBOOK_MAX_SYMBOLS 4
+#endif
+
+// Recorded presses at least this many ticks long count as a dash.
+#ifndef CODEBOOK_DASH_TICKS
+#define CODEBOOK_DASH_TICKS 8
+#endif
+
+// Ticks the button has to stay up after the last press before the recording
+// is looked up in the codebook.
+#ifndef CODEBOOK_END_GAP
+#define CODEBOOK_END_GAP 16
+#endif
+
+// Canonical timing the receiver renders a code with, in ticks.
+#ifndef CODEBOOK_DOT_LENGTH
+#define CODEBOOK_DOT_LENGTH 4
+#endif
+
+#ifndef CODEBOOK_DASH_LENGTH
+#define CODEBOOK_DASH_LENGTH 12
+#endif
+
+#ifndef CODEBOOK_GAP_LENGTH
+#define CODEBOOK_GAP_LENGTH 4
+#endif
+
+#define CODEBOOK_NO_MATCH -1
+
+
+/**
+ * A pre-agreed pattern: symbols presses, bit i of dashes set if press i is
+ * long, and the class the message is sent with at least.
+ */
+typedef struct {
+	uint8_t symbols;
+	uint8_t dashes;
+	uint8_t priority;
+} codebook_entry_t;
+
+
+/**
+ *  Global Functions
+ */
+void codebook_init();
+void codebook_load(const codebook_entry_t *entries, uint8_t count);
+uint8_t codebook_copy(codebook_entry_t *entries);
+int16_t codebook_match(uint64_t data, uint8_t count);
+bool codebook_render(uint16_t code, uint64_t *pattern);
+uint8_t codebook_priority(uint16_t code);
@@ -0,0 +1,155 @@
+#include "config.h"
+
+#include <string.h>
+
+extern CRC_HandleTypeDef hcrc;
+
+config_t config;
+
+static uint16_t version = 0;
+static int16_t activePage = -1;
+
+/**
+ * Private Function Definitions
+ */
+static const config_record_t* config_page(uint8_t page);
+static bool config_valid(const config_record_t *record);
+static void config_apply(const config_blob_t *blob);
+static bool config_write(uint8_t page, const config_record_t *record);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Starts from the build time defaults and switches to the stored blob if one
+ * of the flash pages holds a valid copy newer than this build. Call after the
+ * codebook and the CRC unit are initialised.
+ */
+void config_init() {
+	config.dutyCycle = DUTY_CYCLE_ON;
+	config.relayTTL = RELAY_TTL;
+	config.copies = RECORD_COPIES;
+	version = CONFIG_VERSION;
+	activePage = -1;
+
+	const uint8_t pages[2] = { CONFIG_PAGE_A, CONFIG_PAGE_B };
+	for (uint8_t i = 0; i < 2; i++) {
+		if (config_valid(config_page(pages[i]))
+				&& (activePage < 0
+						|| config_page(pages[i])->version
+								> config_page(activePage)->version)) {
+			activePage = pages[i];
+		}
+	}
+	if (activePage >= 0 && config_page(activePage)->version > version) {
+		config_apply(&config_page(activePage)->blob);
+		version = config_page(activePage)->version;
+	}
+}
+
+uint16_t config_version() {
+	return version;
+}
+
+/**
+ * Master side: serialises the settings in use for distribution, returns the
+ * blob length
+ */
+uint16_t config_export(config_blob_t *blob) {
+	memset(blob, 0, sizeof(config_blob_t));
+	blob->config = config;
+	blob->codebookCount = codebook_copy(blob->codebook);
+	return sizeof(config_blob_t);
+}
+
+/**
+ * Checks a received blob and commits it to the flash page not holding the
+ * current config, then applies it. The page is only recognised once its magic
+ * is written, which happens last, so a reset midway leaves the old copy in
+ * charge.
+ */
+bool config_commit(const uint8_t *blob, uint16_t length, uint16_t newVersion,
+		uint32_t crc) {
+	if (length != sizeof(config_blob_t) || config_crc(blob, length) != crc) {
+		return false;
+	}
+
+	config_record_t record;
+	memset(&record, 0, sizeof(record));
+	record.magic = CONFIG_MAGIC;
+	record.version = newVersion;
+	record.length = length;
+	record.crc = crc;
+	memcpy(&record.blob, blob, length);
+
+	uint8_t page = activePage == CONFIG_PAGE_A ? CONFIG_PAGE_B : CONFIG_PAGE_A;
+	if (!config_write(page, &record) || !config_valid(config_page(page))) {
+		return false;
+	}
+	activePage = page;
+	version = newVersion;
+	config_apply(&record.blob);
+	return true;
+}
+
+/**
+ * CRC-32 of a byte buffer on the CRC unit
+ */
+uint32_t config_crc(const void *data, uint16_t length) {
+	return HAL_CRC_Calculate(&hcrc, (uint32_t*) data, length);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static const config_record_t* config_page(uint8_t page) {
+	return (const config_record_t*) (FLASH_BASE + FLASH_PAGE_SIZE * page);
+}
+
+static bool config_valid(const config_record_t *record) {
+	return record->magic == CONFIG_MAGIC
+			&& record->length == sizeof(config_blob_t)
+			&& config_crc(&record->blob, record->length) == record->crc;
+}
+
+static void config_apply(const config_blob_t *blob) {
+	config = blob->config;
+	codebook_load(blob->codebook, blob->codebookCount);
+}
+
+/**
+ * Erases the page and programs the record a double word at a time, back to
+ * front so the magic at the start lands last
+ */
+static bool config_write(uint8_t page, const config_record_t *record) {
+	uint64_t words[(sizeof(config_record_t) + 7) / 8] = { 0 };
+	memcpy(words, record, sizeof(config_record_t));
+
+	FLASH_EraseInitTypeDef erase;
+	erase.Banks = FLASH_BANK_1;
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Page = page;
+	erase.NbPages = 1;
+
+	uint32_t addr = FLASH_BASE + FLASH_PAGE_SIZE * page;
+	uint32_t pgerr = 0;
+	bool ok = true;
+	HAL_FLASH_Unlock();
+	if (HAL_FLASHEx_Erase(&erase, &pgerr) != HAL_OK) {
+		ok = false;
+	}
+	for (int16_t i = sizeof(words) / sizeof(words[0]) - 1; ok && i >= 0; i--) {
+		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD,
+				addr + sizeof(uint64_t) * i, words[i]) != HAL_OK) {
+			ok = false;
+		}
+	}
+	HAL_FLASH_Lock();
+	return ok;
+}
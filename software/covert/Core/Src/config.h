@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+#include "codebook.h"
+
+// Two flash pages hold the stored config alternately, so a commit never
+// overwrites the copy we would fall back to.
+#ifndef CONFIG_PAGE_A
+#define CONFIG_PAGE_A (FLASH_PAGE_NB - 3)
+#endif
+
+#ifndef CONFIG_PAGE_B
+#define CONFIG_PAGE_B (FLASH_PAGE_NB - 4)
+#endif
+
+#define CONFIG_MAGIC 0xC0DEB00C
+
+
+/**
+ * Settings the whole team shares, replacing the build time defines. The group
+ * a device belongs to stays per device (DEVICE_GROUP), since a push would
+ * otherwise move everyone into the master's group.
+ */
+typedef struct __attribute__((__packed__)) {
+	uint8_t dutyCycle;  // vibration strength in tenths
+	uint8_t relayTTL;   // hops our own messages may take
+	uint8_t copies;     // times each message is sent
+} config_t;
+
+/**
+ * What the master distributes: the settings and the codebook.
+ */
+typedef struct __attribute__((__packed__)) {
+	config_t config;
+	uint8_t codebookCount;
+	codebook_entry_t codebook[CODEBOOK_SIZE];
+} config_blob_t;
+
+/**
+ * Layout of a flash page holding a committed blob.
+ */
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t length;
+	uint32_t crc;
+	uint32_t _reserved;
+	config_blob_t blob;
+} config_record_t;
+
+
+/**
+ *  Global Variables
+ */
+extern config_t config;
+
+
+/**
+ *  Global Functions
+ */
+void config_init();
+uint16_t config_version();
+uint16_t config_export(config_blob_t *blob);
+bool config_commit(const uint8_t *blob, uint16_t length, uint16_t version,
+		uint32_t crc);
+uint32_t config_crc(const void *data, uint16_t length);
@@ -0,0 +1,163 @@
+#include "entropy.h"
+
+extern RNG_HandleTypeDef hrng;
+
+#define ENTROPY_MASK (ENTROPY_RING_SIZE - 1)
+
+static uint32_t ring[ENTROPY_RING_SIZE];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+// A word is on its way from the RNG
+static volatile bool running = false;
+// The RNG stopped on a failure and waits for entropy_poll to restart it
+static volatile bool fault = false;
+static volatile entropy_status_t status = ENTROPY_OK;
+static volatile uint16_t failures = 0;
+
+/**
+ * Private Function Definitions
+ */
+static void entropy_arm();
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Empties the ring and starts filling it. Call after the RNG is initialised.
+ */
+void entropy_init() {
+	__disable_irq();
+	head = 0;
+	tail = 0;
+	running = false;
+	fault = false;
+	status = ENTROPY_OK;
+	failures = 0;
+	entropy_arm();
+	__enable_irq();
+}
+
+/**
+ * Takes one word from the ring without waiting. False, with the word 0, if
+ * the ring has run dry or the RNG failed. Fine for backoffs and jitter, and
+ * safe from interrupts.
+ */
+bool entropy_get(uint32_t *word) {
+	bool taken = false;
+
+	*word = 0;
+	__disable_irq();
+	if (head != tail) {
+		*word = ring[tail & ENTROPY_MASK];
+		tail++;
+		taken = true;
+	}
+	entropy_arm();
+	__enable_irq();
+	return taken;
+}
+
+/**
+ * Takes words for key material, sleeping for the ring to refill if it holds
+ * too few. False if the RNG failed or took longer than ENTROPY_TIMEOUT. Only
+ * from the main loop, the refill needs the RNG interrupt.
+ */
+bool entropy_fill(uint32_t *words, uint8_t count) {
+	uint32_t start = HAL_GetTick();
+
+	for (uint8_t i = 0; i < count; i++) {
+		__disable_irq();
+		while (head == tail && !fault
+				&& HAL_GetTick() - start < ENTROPY_TIMEOUT) {
+			entropy_arm();
+			__WFI();
+			__enable_irq();
+			__disable_irq();
+		}
+		__enable_irq();
+		if (fault || !entropy_get(&words[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Main loop: brings the RNG back after a health check failure. The failure
+ * stays on record for entropy_status.
+ */
+void entropy_poll() {
+	if (!fault) {
+		return;
+	}
+	HAL_RNG_DeInit(&hrng);
+	if (HAL_RNG_Init(&hrng) != HAL_OK) {
+		return;
+	}
+	__disable_irq();
+	fault = false;
+	entropy_arm();
+	__enable_irq();
+}
+
+entropy_status_t entropy_status() {
+	return status;
+}
+
+/**
+ * Health check failures since boot
+ */
+uint16_t entropy_failures() {
+	return failures;
+}
+
+void HAL_RNG_ReadyDataCallback(RNG_HandleTypeDef *hrng, uint32_t random32bit) {
+	__disable_irq();
+	running = false;
+	if ((uint8_t) (head - tail) < ENTROPY_RING_SIZE) {
+		ring[head & ENTROPY_MASK] = random32bit;
+		head++;
+	}
+	entropy_arm();
+	__enable_irq();
+}
+
+/**
+ * A clock error leaves the words already drawn good, after a seed error none
+ * of them are trusted any more. Either way the RNG stays stopped until the
+ * main loop restarts it.
+ */
+void HAL_RNG_ErrorCallback(RNG_HandleTypeDef *hrng) {
+	__HAL_RNG_DISABLE_IT(hrng);
+	running = false;
+	fault = true;
+	failures++;
+	if (hrng->ErrorCode == HAL_RNG_ERROR_SEED) {
+		status = ENTROPY_SEED_ERROR;
+		tail = head;
+	} else {
+		status = ENTROPY_CLOCK_ERROR;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * Asks the RNG for one more word if the ring has room and none is on its
+ * way. Called with interrupts off.
+ */
+static void entropy_arm() {
+	if (running || fault || (uint8_t) (head - tail) >= ENTROPY_RING_SIZE) {
+		return;
+	}
+	if (HAL_RNG_GenerateRandomNumber_IT(&hrng) == HAL_OK) {
+		running = true;
+	}
+}
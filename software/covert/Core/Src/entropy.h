@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Words of hardware randomness kept ready, a power of two. The RNG interrupt
+// tops the ring up in the background, so taking a word is a copy rather than
+// a wait for DRDY.
+#ifndef ENTROPY_RING_SIZE
+#define ENTROPY_RING_SIZE 16
+#endif
+
+// Longest entropy_fill waits for the ring to refill before giving up, in ms.
+#ifndef ENTROPY_TIMEOUT
+#define ENTROPY_TIMEOUT 10
+#endif
+
+
+/**
+ * Last health check failure the RNG reported.
+ */
+typedef enum
+{
+	ENTROPY_OK = 0,            // No failure so far.
+	ENTROPY_CLOCK_ERROR = 1,   // The RNG clock ran too slow.
+	ENTROPY_SEED_ERROR = 2,    // The noise source failed its health test.
+} entropy_status_t;
+
+
+/**
+ *  Global Functions
+ */
+void entropy_init();
+bool entropy_get(uint32_t *word);
+bool entropy_fill(uint32_t *words, uint8_t count);
+void entropy_poll();
+entropy_status_t entropy_status();
+uint16_t entropy_failures();
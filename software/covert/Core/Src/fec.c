@@ -0,0 +1,195 @@
+#include "fec.h"
+
+#include <string.h>
+
+static uint8_t gfExp[512];
+static uint8_t gfLog[256];
+
+/**
+ * Private Function Definitions
+ */
+static uint8_t fec_mul(uint8_t a, uint8_t b);
+static uint8_t fec_inv(uint8_t a);
+static uint8_t fec_coefficient(uint8_t row, uint8_t column);
+static bool fec_invert(uint8_t *matrix, uint8_t n);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Builds the log and exp tables of the field
+ */
+void fec_init() {
+	uint16_t x = 1;
+	for (uint16_t i = 0; i < 255; i++) {
+		gfExp[i] = x;
+		gfLog[x] = i;
+		x <<= 1;
+		if (x & 0x100) {
+			x ^= FEC_POLY;
+		}
+	}
+	// doubled so a sum of two logs needs no reduction
+	for (uint16_t i = 255; i < 512; i++) {
+		gfExp[i] = gfExp[i - 255];
+	}
+	gfLog[0] = 0;
+}
+
+/**
+ * Computes parity row of k data blocks of size bytes each, stored back to back
+ */
+void fec_encode(const uint8_t *blocks, uint8_t k, uint8_t row, uint8_t size,
+		uint8_t *parity) {
+	memset(parity, 0, size);
+	for (uint8_t i = 0; i < k; i++) {
+		uint8_t c = fec_coefficient(row, i);
+		for (uint8_t j = 0; j < size; j++) {
+			parity[j] ^= fec_mul(c, blocks[i * size + j]);
+		}
+	}
+}
+
+/**
+ * Rebuilds the data blocks missing from present using the parity rows set in
+ * rows, stored in parity at row * size. Returns false if fewer parity rows
+ * than missing blocks are held.
+ */
+bool fec_decode(uint8_t *blocks, uint8_t k, uint8_t present,
+		const uint8_t *parity, uint8_t rows, uint8_t size) {
+	uint8_t erased[FEC_MAX_ROWS];
+	uint8_t used[FEC_MAX_ROWS];
+	uint8_t r = 0;
+	uint8_t n = 0;
+
+	for (uint8_t i = 0; i < k; i++) {
+		if (!((present >> i) & 1)) {
+			if (r == FEC_MAX_ROWS) {
+				return false;
+			}
+			erased[r++] = i;
+		}
+	}
+	if (r == 0) {
+		return true;
+	}
+	for (uint8_t row = 0; row < FEC_MAX_ROWS && n < r; row++) {
+		if ((rows >> row) & 1) {
+			used[n++] = row;
+		}
+	}
+	if (n < r) {
+		return false;
+	}
+
+	// the parity rows with the known blocks taken out only depend on the
+	// erased ones, through a square Cauchy matrix which is always invertible
+	uint8_t matrix[FEC_MAX_ROWS * FEC_MAX_ROWS];
+	uint8_t syndrome[FEC_MAX_ROWS][size];
+	for (uint8_t a = 0; a < r; a++) {
+		memcpy(syndrome[a], parity + used[a] * size, size);
+		for (uint8_t i = 0; i < k; i++) {
+			if ((present >> i) & 1) {
+				uint8_t c = fec_coefficient(used[a], i);
+				for (uint8_t j = 0; j < size; j++) {
+					syndrome[a][j] ^= fec_mul(c, blocks[i * size + j]);
+				}
+			}
+		}
+		for (uint8_t b = 0; b < r; b++) {
+			matrix[a * r + b] = fec_coefficient(used[a], erased[b]);
+		}
+	}
+	if (!fec_invert(matrix, r)) {
+		return false;
+	}
+
+	for (uint8_t b = 0; b < r; b++) {
+		uint8_t *block = blocks + erased[b] * size;
+		memset(block, 0, size);
+		for (uint8_t a = 0; a < r; a++) {
+			uint8_t c = matrix[b * r + a];
+			for (uint8_t j = 0; j < size; j++) {
+				block[j] ^= fec_mul(c, syndrome[a][j]);
+			}
+		}
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static uint8_t fec_mul(uint8_t a, uint8_t b) {
+	if (a == 0 || b == 0) {
+		return 0;
+	}
+	return gfExp[gfLog[a] + gfLog[b]];
+}
+
+static uint8_t fec_inv(uint8_t a) {
+	return gfExp[255 - gfLog[a]];
+}
+
+/**
+ * Cauchy matrix entry 1 / (x + y), with x = FEC_MAX_K + row and y = column
+ * kept apart so the sum is never zero
+ */
+static uint8_t fec_coefficient(uint8_t row, uint8_t column) {
+	return fec_inv((FEC_MAX_K + row) ^ column);
+}
+
+/**
+ * Gauss-Jordan inversion of an n by n matrix in place
+ */
+static bool fec_invert(uint8_t *matrix, uint8_t n) {
+	uint8_t inverse[FEC_MAX_ROWS * FEC_MAX_ROWS];
+	memset(inverse, 0, sizeof(inverse));
+	for (uint8_t i = 0; i < n; i++) {
+		inverse[i * n + i] = 1;
+	}
+
+	for (uint8_t col = 0; col < n; col++) {
+		uint8_t pivot = col;
+		while (pivot < n && matrix[pivot * n + col] == 0) {
+			pivot++;
+		}
+		if (pivot == n) {
+			return false;
+		}
+		if (pivot != col) {
+			for (uint8_t j = 0; j < n; j++) {
+				uint8_t t = matrix[col * n + j];
+				matrix[col * n + j] = matrix[pivot * n + j];
+				matrix[pivot * n + j] = t;
+				t = inverse[col * n + j];
+				inverse[col * n + j] = inverse[pivot * n + j];
+				inverse[pivot * n + j] = t;
+			}
+		}
+
+		uint8_t scale = fec_inv(matrix[col * n + col]);
+		for (uint8_t j = 0; j < n; j++) {
+			matrix[col * n + j] = fec_mul(matrix[col * n + j], scale);
+			inverse[col * n + j] = fec_mul(inverse[col * n + j], scale);
+		}
+		for (uint8_t i = 0; i < n; i++) {
+			uint8_t factor = matrix[i * n + col];
+			if (i == col || factor == 0) {
+				continue;
+			}
+			for (uint8_t j = 0; j < n; j++) {
+				matrix[i * n + j] ^= fec_mul(factor, matrix[col * n + j]);
+				inverse[i * n + j] ^= fec_mul(factor, inverse[col * n + j]);
+			}
+		}
+	}
+	memcpy(matrix, inverse, n * n);
+	return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Systematic Reed-Solomon erasure code over GF(256) built from a Cauchy
+// matrix: k data blocks plus any parity rows, and any k of the data and
+// parity blocks give back the data.
+
+// Data blocks per code group, present blocks are passed as a uint8_t mask.
+#define FEC_MAX_K 8
+
+// Distinct parity rows per group.
+#ifndef FEC_MAX_ROWS
+#define FEC_MAX_ROWS 4
+#endif
+
+// Reduction polynomial x^8 + x^4 + x^3 + x^2 + 1.
+#define FEC_POLY 0x11D
+
+
+/**
+ *  Global Functions
+ */
+void fec_init();
+void fec_encode(const uint8_t *blocks, uint8_t k, uint8_t row, uint8_t size,
+		uint8_t *parity);
+bool fec_decode(uint8_t *blocks, uint8_t k, uint8_t present,
+		const uint8_t *parity, uint8_t rows, uint8_t size);
@@ -0,0 +1,374 @@
+#include "gcm.h"
+#include "keyslot.h"
+
+#include <string.h>
+
+extern CRYP_HandleTypeDef hcryp;
+
+static gcm_entry_t pool[GCM_POOL_SIZE];
+static gcm_peer_t peers[GCM_PEERS];
+static uint8_t peerNext = 0;
+
+// GHASH tables for H = E(K, 0) of each slot: the products of H with every
+// 4 bit value, split in high and low halves
+static uint64_t hashHigh[KEYSLOT_COUNT][16];
+static uint64_t hashLow[KEYSLOT_COUNT][16];
+static uint16_t hashGeneration[KEYSLOT_COUNT];
+
+// Reduction of the four bits shifted out at the bottom of a product.
+static const uint16_t reduction[16] = { 0x0000, 0x1C20, 0x3840, 0x2460,
+		0x7080, 0x6CA0, 0x48C0, 0x54E0, 0xE100, 0xFD20, 0xD940, 0xC560,
+		0x9180, 0x8DA0, 0xA9C0, 0xB5E0 };
+
+// CTR mode over zeros gives the bare keystream
+static uint32_t zeros[GCM_STREAM_WORDS];
+
+/**
+ * Private Function Definitions
+ */
+static void gcm_expect(uint8_t slot, uint8_t source, uint32_t counter);
+static void gcm_fill(uint8_t slot, uint8_t source, uint32_t counter,
+		uint32_t nextCounter);
+static bool gcm_wanted(const gcm_entry_t *entry, uint32_t nextCounter);
+static const uint8_t* gcm_stream(uint8_t slot, uint8_t source,
+		uint32_t counter, uint32_t *scratch);
+static bool gcm_generate(uint8_t slot, uint8_t source, uint32_t counter,
+		uint32_t *stream);
+static bool gcm_hashKey(uint8_t slot);
+static void gcm_ghash(uint8_t slot, const uint8_t *aad, uint16_t aadLength,
+		const uint8_t *data, uint16_t length, uint8_t *hash);
+static void gcm_absorb(uint8_t slot, uint8_t *hash, const uint8_t *data,
+		uint16_t length);
+static void gcm_multiply(uint8_t slot, uint8_t *x);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Drops every precomputed keystream and hash key
+ */
+void gcm_init() {
+	memset(pool, 0, sizeof(pool));
+	memset(peers, 0, sizeof(peers));
+	memset(hashGeneration, 0, sizeof(hashGeneration));
+	memset(zeros, 0, sizeof(zeros));
+	peerNext = 0;
+}
+
+/**
+ * Idle time work: makes sure the keystreams for our next frame counters and
+ * for the counter each recent peer will use next are in the pool. Entries
+ * nobody will ask for any more are the ones replaced.
+ */
+void gcm_refill(uint32_t nextCounter) {
+	// the receive callback uses the AES and the pool too
+	for (uint8_t i = 0; i < GCM_AHEAD; i++) {
+		HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+		gcm_fill(KEYSLOT_NETWORK, DEVICE_ID, nextCounter + i, nextCounter);
+		HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	}
+	for (uint8_t i = 0; i < GCM_PEERS; i++) {
+		HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+		if (peers[i].valid) {
+			gcm_fill(peers[i].slot, peers[i].source, peers[i].counter,
+					nextCounter);
+		}
+		HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	}
+}
+
+/**
+ * Encrypts a payload in place and writes its truncated tag, which also covers
+ * the header. The nonce is the header's source and frame counter. Returns
+ * false if the keystream could not be had from the AES.
+ */
+bool gcm_seal(uint8_t slot, const FrameHeader *header, uint8_t *payload,
+		uint16_t length, uint8_t *tag) {
+	uint32_t scratch[GCM_STREAM_WORDS];
+	uint8_t hash[16];
+
+	if (length > GCM_MAX_PAYLOAD || !gcm_hashKey(slot)) {
+		return false;
+	}
+	const uint8_t *stream = gcm_stream(slot, header->source,
+			header->sequenceNumber, scratch);
+	if (stream == NULL) {
+		return false;
+	}
+	for (uint16_t i = 0; i < length; i++) {
+		payload[i] ^= stream[16 + i];
+	}
+	gcm_ghash(slot, (const uint8_t*) header, sizeof(FrameHeader), payload,
+			length, hash);
+	for (uint8_t i = 0; i < FRAME_TAG_LENGTH; i++) {
+		tag[i] = hash[i] ^ stream[i];
+	}
+	return true;
+}
+
+/**
+ * Checks a payload's tag and decrypts it in place if it holds. A frame that
+ * opens tells us which frame counter its source will use next.
+ */
+bool gcm_open(uint8_t slot, const FrameHeader *header, uint8_t *payload,
+		uint16_t length, const uint8_t *tag) {
+	uint32_t scratch[GCM_STREAM_WORDS];
+	uint8_t hash[16];
+	uint8_t difference = 0;
+
+	if (length > GCM_MAX_PAYLOAD || !gcm_hashKey(slot)) {
+		return false;
+	}
+	const uint8_t *stream = gcm_stream(slot, header->source,
+			header->sequenceNumber, scratch);
+	if (stream == NULL) {
+		return false;
+	}
+	gcm_ghash(slot, (const uint8_t*) header, sizeof(FrameHeader), payload,
+			length, hash);
+	for (uint8_t i = 0; i < FRAME_TAG_LENGTH; i++) {
+		difference |= tag[i] ^ hash[i] ^ stream[i];
+	}
+	if (difference != 0) {
+		return false;
+	}
+	for (uint16_t i = 0; i < length; i++) {
+		payload[i] ^= stream[16 + i];
+	}
+	gcm_expect(slot, header->source, header->sequenceNumber + 1);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static void gcm_expect(uint8_t slot, uint8_t source, uint32_t counter) {
+	if (source == DEVICE_ID) {
+		return;
+	}
+	for (uint8_t i = 0; i < GCM_PEERS; i++) {
+		if (peers[i].valid && peers[i].slot == slot
+				&& peers[i].source == source) {
+			peers[i].counter = counter;
+			return;
+		}
+	}
+	peers[peerNext].valid = true;
+	peers[peerNext].slot = slot;
+	peers[peerNext].source = source;
+	peers[peerNext].counter = counter;
+	peerNext = (peerNext + 1) % GCM_PEERS;
+}
+
+/**
+ * Puts one keystream in the pool unless it is there already. There is always
+ * an entry that is not wanted, since the pool holds as many as can be.
+ */
+static void gcm_fill(uint8_t slot, uint8_t source, uint32_t counter,
+		uint32_t nextCounter) {
+	uint16_t generation = keyslot_generation(slot);
+
+	if (generation == 0) {
+		return;
+	}
+	for (uint8_t i = 0; i < GCM_POOL_SIZE; i++) {
+		if (pool[i].valid && pool[i].slot == slot
+				&& pool[i].generation == generation && pool[i].source == source
+				&& pool[i].counter == counter) {
+			return;
+		}
+	}
+	for (uint8_t i = 0; i < GCM_POOL_SIZE; i++) {
+		if (!gcm_wanted(&pool[i], nextCounter)) {
+			pool[i].valid = false;
+			if (gcm_generate(slot, source, counter, pool[i].stream)) {
+				pool[i].slot = slot;
+				pool[i].generation = generation;
+				pool[i].source = source;
+				pool[i].counter = counter;
+				pool[i].valid = true;
+			}
+			return;
+		}
+	}
+}
+
+/**
+ * True while an entry is one of ours coming up or a peer's expected next one,
+ * under the key its slot holds now
+ */
+static bool gcm_wanted(const gcm_entry_t *entry, uint32_t nextCounter) {
+	if (!entry->valid
+			|| entry->generation != keyslot_generation(entry->slot)) {
+		return false;
+	}
+	if (entry->source == DEVICE_ID) {
+		return entry->slot == KEYSLOT_NETWORK
+				&& entry->counter - nextCounter < GCM_AHEAD;
+	}
+	for (uint8_t i = 0; i < GCM_PEERS; i++) {
+		if (peers[i].valid && peers[i].slot == entry->slot
+				&& peers[i].source == entry->source
+				&& peers[i].counter == entry->counter) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * The keystream for a frame, from the pool if it was worked out ahead of time
+ * and otherwise made now in the scratch buffer. NULL if the AES failed.
+ */
+static const uint8_t* gcm_stream(uint8_t slot, uint8_t source,
+		uint32_t counter, uint32_t *scratch) {
+	uint16_t generation = keyslot_generation(slot);
+
+	for (uint8_t i = 0; i < GCM_POOL_SIZE; i++) {
+		if (pool[i].valid && pool[i].slot == slot
+				&& pool[i].generation == generation && pool[i].source == source
+				&& pool[i].counter == counter) {
+			return (const uint8_t*) pool[i].stream;
+		}
+	}
+	if (!gcm_generate(slot, source, counter, scratch)) {
+		return NULL;
+	}
+	return (const uint8_t*) scratch;
+}
+
+/**
+ * Runs the AES in CTR mode from the GCM counter block J0: the 96 bit nonce of
+ * source and frame counter, then a block counter of 1. The first block masks
+ * the tag and the payload's keystream starts at 2, as in the standard.
+ */
+static bool gcm_generate(uint8_t slot, uint8_t source, uint32_t counter,
+		uint32_t *stream) {
+	uint32_t iv[4] = { source, counter, 0, 1 };
+
+	return keyslot_use(slot, CRYP_AES_CTR, iv, NULL, 0) == HAL_OK
+			&& keyslot_run(zeros, sizeof(zeros), stream) == HAL_OK;
+}
+
+/**
+ * Builds the GHASH tables once per key, from H = E(K, 0)
+ */
+static bool gcm_hashKey(uint8_t slot) {
+	uint16_t generation = keyslot_generation(slot);
+	uint32_t block[4] = { 0 };
+	uint32_t h[4];
+	uint64_t *high = hashHigh[slot];
+	uint64_t *low = hashLow[slot];
+	uint64_t vh = 0;
+	uint64_t vl = 0;
+
+	if (generation == 0) {
+		return false;
+	}
+	if (hashGeneration[slot] == generation) {
+		return true;
+	}
+	if (keyslot_use(slot, CRYP_AES_ECB, NULL, NULL, 0) != HAL_OK
+			|| HAL_CRYP_Encrypt(&hcryp, block, 16, h, 1) != HAL_OK) {
+		return false;
+	}
+	for (uint8_t i = 0; i < 8; i++) {
+		vh = (vh << 8) | ((uint8_t*) h)[i];
+		vl = (vl << 8) | ((uint8_t*) h)[8 + i];
+	}
+	high[0] = 0;
+	low[0] = 0;
+	high[8] = vh;
+	low[8] = vl;
+	// H times x, x^2 and x^3 in GCM's reflected bit order
+	for (uint8_t i = 4; i > 0; i >>= 1) {
+		uint32_t carry = (vl & 1) * 0xE1000000u;
+		vl = (vh << 63) | (vl >> 1);
+		vh = (vh >> 1) ^ ((uint64_t) carry << 32);
+		high[i] = vh;
+		low[i] = vl;
+	}
+	for (uint8_t i = 2; i <= 8; i *= 2) {
+		for (uint8_t j = 1; j < i; j++) {
+			high[i + j] = high[i] ^ high[j];
+			low[i + j] = low[i] ^ low[j];
+		}
+	}
+	hashGeneration[slot] = generation;
+	return true;
+}
+
+/**
+ * GHASH over the header, the ciphertext and their lengths in bits
+ */
+static void gcm_ghash(uint8_t slot, const uint8_t *aad, uint16_t aadLength,
+		const uint8_t *data, uint16_t length, uint8_t *hash) {
+	uint8_t lengths[16] = { 0 };
+
+	memset(hash, 0, 16);
+	gcm_absorb(slot, hash, aad, aadLength);
+	gcm_absorb(slot, hash, data, length);
+
+	uint32_t aadBits = (uint32_t) aadLength * 8;
+	uint32_t dataBits = (uint32_t) length * 8;
+	for (uint8_t i = 0; i < 4; i++) {
+		lengths[7 - i] = aadBits >> (8 * i);
+		lengths[15 - i] = dataBits >> (8 * i);
+	}
+	gcm_absorb(slot, hash, lengths, sizeof(lengths));
+}
+
+/**
+ * Folds data into the hash a block at a time, the last one zero padded
+ */
+static void gcm_absorb(uint8_t slot, uint8_t *hash, const uint8_t *data,
+		uint16_t length) {
+	while (length > 0) {
+		uint16_t n = length < 16 ? length : 16;
+
+		for (uint8_t i = 0; i < n; i++) {
+			hash[i] ^= data[i];
+		}
+		gcm_multiply(slot, hash);
+		data += n;
+		length -= n;
+	}
+}
+
+/**
+ * x = x * H in GF(2^128), four bits at a time from the last byte back
+ */
+static void gcm_multiply(uint8_t slot, uint8_t *x) {
+	const uint64_t *high = hashHigh[slot];
+	const uint64_t *low = hashLow[slot];
+	uint8_t nibble = x[15] & 0x0F;
+	uint64_t zh = high[nibble];
+	uint64_t zl = low[nibble];
+
+	for (int8_t i = 15; i >= 0; i--) {
+		if (i != 15) {
+			nibble = x[i] & 0x0F;
+			uint8_t rem = zl & 0x0F;
+			zl = (zh << 60) | (zl >> 4);
+			zh = (zh >> 4) ^ ((uint64_t) reduction[rem] << 48);
+			zh ^= high[nibble];
+			zl ^= low[nibble];
+		}
+		nibble = x[i] >> 4;
+		uint8_t rem = zl & 0x0F;
+		zl = (zh << 60) | (zl >> 4);
+		zh = (zh >> 4) ^ ((uint64_t) reduction[rem] << 48);
+		zh ^= high[nibble];
+		zl ^= low[nibble];
+	}
+	for (uint8_t i = 0; i < 8; i++) {
+		x[i] = zh >> (56 - 8 * i);
+		x[8 + i] = zl >> (56 - 8 * i);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+#include "txqueue.h"
+
+// AES-GCM split in two: the AES only produces the CTR keystream, which is
+// worked out ahead of time for the frame counters we expect to seal or open
+// next, and GHASH runs in software. Sealing an expected frame is then an XOR
+// and a GHASH, without waiting on the peripheral.
+
+// Largest payload a frame carries.
+#define GCM_MAX_PAYLOAD (AGGREGATE_MAX * sizeof(Packet))
+
+// Keystream for one frame: E(K, J0) to mask the tag, then the payload blocks.
+#define GCM_STREAM_WORDS (4 + GCM_MAX_PAYLOAD / sizeof(uint32_t))
+
+// Frame counters of our own kept ready ahead of the one in use.
+#ifndef GCM_AHEAD
+#define GCM_AHEAD 2
+#endif
+
+// Peers whose next frame counter we keep a keystream ready for.
+#ifndef GCM_PEERS
+#define GCM_PEERS 4
+#endif
+
+#define GCM_POOL_SIZE (GCM_AHEAD + GCM_PEERS)
+
+
+/**
+ * Keystream for one (key, source, frame counter).
+ */
+typedef struct {
+	volatile bool valid;
+	uint8_t slot;
+	uint16_t generation;
+	uint8_t source;
+	uint32_t counter;
+	uint32_t stream[GCM_STREAM_WORDS];
+} gcm_entry_t;
+
+/**
+ * The frame counter a peer is expected to use next.
+ */
+typedef struct {
+	bool valid;
+	uint8_t slot;
+	uint8_t source;
+	uint32_t counter;
+} gcm_peer_t;
+
+
+/**
+ *  Global Functions
+ */
+void gcm_init();
+void gcm_refill(uint32_t nextCounter);
+bool gcm_seal(uint8_t slot, const FrameHeader *header, uint8_t *payload,
+		uint16_t length, uint8_t *tag);
+bool gcm_open(uint8_t slot, const FrameHeader *header, uint8_t *payload,
+		uint16_t length, const uint8_t *tag);
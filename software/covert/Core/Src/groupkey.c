@@ -0,0 +1,207 @@
+#include "groupkey.h"
+#include "keyslot.h"
+#include "kdf.h"
+
+#include <string.h>
+
+static uint32_t current[4];
+static volatile uint8_t epoch = 0;
+static volatile uint8_t previousEpoch = 0;
+static volatile bool previousValid = false;
+static uint32_t changedAt = 0;
+// Keys for address tags, derived like the frame keys: current, then previous
+static uint32_t tagKeys[2][4];
+
+// Master: REKEY copies still to send and when the next one may go
+static uint8_t copiesLeft = 0;
+static uint32_t copyDue = 0;
+
+/**
+ * Private Function Definitions
+ */
+static bool groupkey_derive(const uint32_t *key, uint8_t keyEpoch,
+		uint32_t *frameKey, uint32_t *tagKey);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Starts over with a team key and its epoch, as read from flash at boot or
+ * handed over by pairing. No previous key is kept. False if the AES failed
+ * to derive the keys, which leaves everything as it was.
+ */
+bool groupkey_init(const uint32_t *key, uint8_t newEpoch) {
+	uint32_t frameKey[4];
+	uint32_t tagKey[4];
+	bool derived;
+
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	derived = groupkey_derive(key, newEpoch % GROUPKEY_EPOCHS, frameKey,
+			tagKey);
+	if (derived) {
+		memcpy(current, key, sizeof(current));
+		memcpy(tagKeys[0], tagKey, sizeof(tagKeys[0]));
+		epoch = newEpoch % GROUPKEY_EPOCHS;
+		previousValid = false;
+		copiesLeft = 0;
+		changedAt = HAL_GetTick();
+		keyslot_set(KEYSLOT_NETWORK, frameKey);
+	}
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	memset(frameKey, 0, sizeof(frameKey));
+	memset(tagKey, 0, sizeof(tagKey));
+	return derived;
+}
+
+/**
+ * Moves to the next epoch's key. The one in use becomes the previous key for
+ * the grace period. On the master this also schedules the REKEY copies that
+ * tell everyone else. False if the AES failed to derive the keys, which
+ * leaves everything as it was.
+ */
+bool groupkey_install(const uint32_t *key, uint8_t newEpoch) {
+	uint32_t frameKey[4];
+	uint32_t tagKey[4];
+	uint32_t previousFrameKey[4];
+	bool derived;
+
+	// the receive callback picks slots by epoch, let it see the change at once
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	// the previous frame key is derived again rather than kept around, its
+	// tag key is the one in use until now
+	derived = groupkey_derive(key, newEpoch % GROUPKEY_EPOCHS, frameKey,
+			tagKey)
+			&& kdf_expand(current, KDF_LABEL_FRAME, epoch, previousFrameKey);
+	if (derived) {
+		keyslot_set(KEYSLOT_PREVIOUS, previousFrameKey);
+		memcpy(tagKeys[1], tagKeys[0], sizeof(tagKeys[1]));
+		previousEpoch = epoch;
+		previousValid = true;
+		memcpy(current, key, sizeof(current));
+		memcpy(tagKeys[0], tagKey, sizeof(tagKeys[0]));
+		epoch = newEpoch % GROUPKEY_EPOCHS;
+		keyslot_set(KEYSLOT_NETWORK, frameKey);
+		changedAt = HAL_GetTick();
+		if (MASTER_DEVICE) {
+			copiesLeft = GROUPKEY_COPIES;
+			copyDue = changedAt;
+		}
+	}
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	memset(frameKey, 0, sizeof(frameKey));
+	memset(tagKey, 0, sizeof(tagKey));
+	memset(previousFrameKey, 0, sizeof(previousFrameKey));
+	return derived;
+}
+
+uint8_t groupkey_epoch() {
+	return epoch;
+}
+
+/**
+ * Epoch to stamp on a frame sealed under a slot
+ */
+uint8_t groupkey_epochOf(uint8_t slot) {
+	if (slot == KEYSLOT_NETWORK) {
+		return epoch;
+	}
+	if (slot == KEYSLOT_PREVIOUS) {
+		return previousEpoch;
+	}
+	return 0;
+}
+
+/**
+ * Slot holding the key of a received frame's epoch. False if we have no key
+ * for it, either because it is too old or because we missed a change.
+ */
+bool groupkey_slot(uint8_t frameEpoch, uint8_t *slot) {
+	if (frameEpoch == epoch) {
+		*slot = KEYSLOT_NETWORK;
+		return true;
+	}
+	if (previousValid && frameEpoch == previousEpoch) {
+		*slot = KEYSLOT_PREVIOUS;
+		return true;
+	}
+	return false;
+}
+
+bool groupkey_previousValid() {
+	return previousValid;
+}
+
+/**
+ * Key the address tags of frames sealed under a slot are made with
+ */
+const uint32_t* groupkey_tagKey(uint8_t slot) {
+	return tagKeys[slot == KEYSLOT_PREVIOUS ? 1 : 0];
+}
+
+/**
+ * Retires the previous key once the grace period is over. Returns true when
+ * it did, so whatever was derived from that key can go too.
+ */
+bool groupkey_poll() {
+	if (previousValid && HAL_GetTick() - changedAt >= GROUPKEY_GRACE) {
+		previousValid = false;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Master: someone sealed a frame with the previous key, so it missed the
+ * REKEY. One more copy goes out, no sooner than the spacing allows.
+ */
+void groupkey_straggler() {
+	if (MASTER_DEVICE && previousValid && copiesLeft == 0) {
+		copiesLeft = 1;
+	}
+}
+
+/**
+ * Master: true when the team key is due for rotation. Never during a grace
+ * period, which would leave stragglers two epochs behind.
+ */
+bool groupkey_rotationDue() {
+	return MASTER_DEVICE && GROUPKEY_INTERVAL > 0 && !previousValid
+			&& copiesLeft == 0 && HAL_GetTick() - changedAt >= GROUPKEY_INTERVAL;
+}
+
+/**
+ * Master: true when a REKEY copy should go out now
+ */
+bool groupkey_copyDue() {
+	return copiesLeft > 0 && previousValid
+			&& (int32_t) (HAL_GetTick() - copyDue) >= 0;
+}
+
+/**
+ * Master: counts a REKEY copy as sent, the next one follows after the spacing
+ */
+void groupkey_copySent() {
+	if (copiesLeft > 0) {
+		copiesLeft--;
+	}
+	copyDue = HAL_GetTick() + GROUPKEY_SPACING;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * The team key itself never goes into the AES: frames are sealed under one
+ * key derived from it and addressed with another, both bound to the epoch
+ */
+static bool groupkey_derive(const uint32_t *key, uint8_t keyEpoch,
+		uint32_t *frameKey, uint32_t *tagKey) {
+	return kdf_expand(key, KDF_LABEL_FRAME, keyEpoch, frameKey)
+			&& kdf_expand(key, KDF_LABEL_ADDRESS, keyEpoch, tagKey);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// The team key changes in epochs. Every frame carries the epoch of the key
+// that sealed it in its flags, and after a change the previous key is still
+// accepted for a grace period so members that missed the news keep working
+// until they catch up.
+
+// Epochs wrap around in the four flag bits.
+#define GROUPKEY_EPOCHS 16
+
+// How long the previous key is still accepted after a change, in ms.
+#ifndef GROUPKEY_GRACE
+#define GROUPKEY_GRACE 120000
+#endif
+
+// Master: rotates the team key this often, in ms. 0 never rotates.
+#ifndef GROUPKEY_INTERVAL
+#define GROUPKEY_INTERVAL 21600000
+#endif
+
+// Master: copies of a REKEY frame sent after a rotation, and the gap
+// between them in ms.
+#ifndef GROUPKEY_COPIES
+#define GROUPKEY_COPIES 3
+#endif
+
+#ifndef GROUPKEY_SPACING
+#define GROUPKEY_SPACING 2000
+#endif
+
+
+/**
+ *  Global Functions
+ */
+bool groupkey_init(const uint32_t *key, uint8_t epoch);
+bool groupkey_install(const uint32_t *key, uint8_t epoch);
+uint8_t groupkey_epoch();
+uint8_t groupkey_epochOf(uint8_t slot);
+bool groupkey_slot(uint8_t epoch, uint8_t *slot);
+bool groupkey_previousValid();
+const uint32_t* groupkey_tagKey(uint8_t slot);
+bool groupkey_poll();
+void groupkey_straggler();
+bool groupkey_rotationDue();
+bool groupkey_copyDue();
+void groupkey_copySent();
@@ -0,0 +1,141 @@
+#include "kdf.h"
+#include "keyslot.h"
+
+#include <string.h>
+
+extern CRYP_HandleTypeDef hcryp;
+
+/**
+ * Private Function Definitions
+ */
+static bool kdf_block(uint8_t *block);
+static void kdf_double(uint8_t *block);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * AES-CMAC of a message under a key: CBC-MAC with the last block masked by
+ * one of two subkeys, depending on whether it had to be padded
+ */
+bool kdf_cmac(const uint32_t *key, const uint8_t *message, uint16_t length,
+		uint8_t *mac) {
+	uint32_t words[4] = { 0 };
+	uint8_t *state = (uint8_t*) words;
+	uint8_t subkey[16];
+
+	keyslot_set(KEYSLOT_SCRATCH, key);
+	if (keyslot_use(KEYSLOT_SCRATCH, CRYP_AES_ECB, NULL, NULL, 0) != HAL_OK
+			|| !kdf_block(state)) {
+		return false;
+	}
+	memcpy(subkey, state, sizeof(subkey));
+	kdf_double(subkey);
+	if (length == 0 || length % 16 != 0) {
+		kdf_double(subkey);
+	}
+
+	memset(state, 0, 16);
+	while (length > 16) {
+		for (uint8_t i = 0; i < 16; i++) {
+			state[i] ^= message[i];
+		}
+		if (!kdf_block(state)) {
+			return false;
+		}
+		message += 16;
+		length -= 16;
+	}
+	for (uint8_t i = 0; i < length; i++) {
+		state[i] ^= message[i];
+	}
+	if (length < 16) {
+		state[length] ^= 0x80;
+	}
+	for (uint8_t i = 0; i < 16; i++) {
+		state[i] ^= subkey[i];
+	}
+	if (!kdf_block(state)) {
+		return false;
+	}
+	memcpy(mac, state, 16);
+	memset(subkey, 0, sizeof(subkey));
+	return true;
+}
+
+/**
+ * A 128 bit key from a secret of any length, such as a Curve25519 shared
+ * secret, instead of cutting it short: the secret itself if it has the
+ * right size, its CMAC under the all zero key otherwise.
+ */
+bool kdf_extract(const uint8_t *secret, uint16_t length, uint32_t *prk) {
+	static const uint32_t zero[4] = { 0 };
+
+	if (length == 16) {
+		memcpy(prk, secret, 16);
+		return true;
+	}
+	return kdf_cmac(zero, secret, length, (uint8_t*) prk);
+}
+
+/**
+ * One 128 bit key for a purpose: CMAC under the input key of
+ * [1] || label || 0x00 || context || [128], the block counter, the label, a
+ * separator, the context and the output length in bits
+ */
+bool kdf_expand(const uint32_t *key, const char *label, uint16_t context,
+		uint32_t *out) {
+	uint8_t message[32];
+	uint8_t length = 0;
+	uint8_t labelLength = strlen(label);
+
+	if (labelLength > sizeof(message) - 6) {
+		return false;
+	}
+	message[length++] = 1;
+	memcpy(message + length, label, labelLength);
+	length += labelLength;
+	message[length++] = 0;
+	message[length++] = context >> 8;
+	message[length++] = context;
+	message[length++] = 0;
+	message[length++] = 128;
+	return kdf_cmac(key, message, length, (uint8_t*) out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * Encrypts one block in place with whatever key the AES was pointed at
+ */
+static bool kdf_block(uint8_t *block) {
+	uint32_t in[4];
+	uint32_t out[4];
+
+	memcpy(in, block, 16);
+	if (HAL_CRYP_Encrypt(&hcryp, in, 16, out, 1) != HAL_OK) {
+		return false;
+	}
+	memcpy(block, out, 16);
+	return true;
+}
+
+/**
+ * Multiplies by x in CMAC's GF(2^128): a left shift, folding 0x87 back in if
+ * the top bit fell out
+ */
+static void kdf_double(uint8_t *block) {
+	uint8_t carry = block[0] >> 7;
+
+	for (uint8_t i = 0; i < 15; i++) {
+		block[i] = (block[i] << 1) | (block[i + 1] >> 7);
+	}
+	block[15] = (block[15] << 1) ^ (0x87 * carry);
+}
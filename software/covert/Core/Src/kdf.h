@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Key derivation on the AES: AES-CMAC (RFC 4493) as the PRF, an extract step
+// that squeezes a longer secret into one 128 bit key as AES-CMAC-PRF-128
+// does (RFC 4615), and one block of the SP 800-108 counter mode KDF to
+// expand it into keys for separate directions and purposes. The AES runs
+// through the scratch key slot, so callers keep the radio interrupt out like
+// any other user of the AES.
+
+// Labels naming what a derived key is for. Keys with different labels or
+// contexts are unrelated.
+#define KDF_LABEL_FRAME "frame"     // Team key: sealing frames.
+#define KDF_LABEL_ADDRESS "address" // Team key: address tags.
+#define KDF_LABEL_DOWN "pairdown"   // Pairing: master to slave.
+#define KDF_LABEL_UP "pairup"       // Pairing: slave to master.
+#define KDF_LABEL_WRAP "keywrap"    // Device key: hiding the stored pairing key.
+#define KDF_LABEL_CHECK "keycheck"  // Device key: authenticating the record.
+
+
+/**
+ *  Global Functions
+ */
+bool kdf_cmac(const uint32_t *key, const uint8_t *message, uint16_t length,
+		uint8_t *mac);
+bool kdf_extract(const uint8_t *secret, uint16_t length, uint32_t *prk);
+bool kdf_expand(const uint32_t *key, const char *label, uint16_t context,
+		uint32_t *out);
@@ -0,0 +1,117 @@
+#include "keyslot.h"
+
+#include <string.h>
+
+extern CRYP_HandleTypeDef hcryp;
+
+static uint32_t keys[KEYSLOT_COUNT][4];
+// Slot whose key the AES registers hold, or KEYSLOT_NONE
+static volatile uint8_t loaded = KEYSLOT_NONE;
+// Bumped on every key change so anything derived from a key can tell it is stale
+static volatile uint16_t generation[KEYSLOT_COUNT];
+// Set from the AES DMA callbacks: 1 when done, 2 on error
+static volatile uint8_t aesDone = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Clears every slot
+ */
+void keyslot_init() {
+	memset(keys, 0, sizeof(keys));
+	memset((void*) generation, 0, sizeof(generation));
+	loaded = KEYSLOT_NONE;
+}
+
+/**
+ * Stores a 128 bit key in a slot. If the AES holds the old one it is loaded
+ * again on the next operation.
+ */
+void keyslot_set(uint8_t slot, const void *key) {
+	__disable_irq();
+	memcpy(keys[slot], key, sizeof(keys[slot]));
+	generation[slot]++;
+	if (loaded == slot) {
+		loaded = KEYSLOT_NONE;
+	}
+	__enable_irq();
+}
+
+/**
+ * Points the AES at a slot's key and a chaining mode for the next operation.
+ * The HAL is set to configure key and IV only once, so they are only written
+ * again when the slot or the mode changes or a new IV is given. Nothing goes
+ * through HAL_CRYP_Init.
+ */
+HAL_StatusTypeDef keyslot_use(uint8_t slot, uint32_t algorithm, uint32_t *iv,
+		uint32_t *header, uint32_t headerSize) {
+	CRYP_ConfigTypeDef conf;
+
+	if (HAL_CRYP_GetConfig(&hcryp, &conf) != HAL_OK) {
+		return HAL_ERROR;
+	}
+	// GCM also needs this to start a new message instead of continuing one
+	if (slot != loaded || algorithm != conf.Algorithm || iv != NULL) {
+		hcryp.KeyIVConfig = 0;
+	}
+	conf.pKey = keys[slot];
+	conf.Algorithm = algorithm;
+	conf.pInitVect = iv;
+	conf.Header = header;
+	conf.HeaderSize = headerSize;
+	if (HAL_CRYP_SetConfig(&hcryp, &conf) != HAL_OK) {
+		return HAL_ERROR;
+	}
+	loaded = slot;
+	return HAL_OK;
+}
+
+/**
+ * Changes every time the slot is given a key, 0 if it never was
+ */
+uint16_t keyslot_generation(uint8_t slot) {
+	return generation[slot];
+}
+
+/**
+ * Streams a buffer through the AES in the mode set by keyslot_use by DMA and
+ * sleeps until it has come out. The DMA interrupts sit above the radio's, so
+ * this also works from the receive callback.
+ */
+HAL_StatusTypeDef keyslot_run(uint32_t *input, uint16_t length,
+		uint32_t *output) {
+	HAL_StatusTypeDef status;
+	uint32_t start = HAL_GetTick();
+
+	aesDone = 0;
+	status = HAL_CRYP_Encrypt_DMA(&hcryp, input, length, output);
+	if (status != HAL_OK) {
+		return status;
+	}
+	__disable_irq();
+	while (!aesDone && HAL_GetTick() - start < KEYSLOT_DMA_TIMEOUT) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+	if (!aesDone) {
+		// a stuck transfer would leave the handle busy for good
+		HAL_CRYP_DeInit(&hcryp);
+		HAL_CRYP_Init(&hcryp);
+		loaded = KEYSLOT_NONE;
+	}
+	return aesDone == 1 ? HAL_OK : HAL_ERROR;
+}
+
+void HAL_CRYP_OutCpltCallback(CRYP_HandleTypeDef *hcryp) {
+	aesDone = 1;
+}
+
+void HAL_CRYP_ErrorCallback(CRYP_HandleTypeDef *hcryp) {
+	aesDone = 2;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+/**
+ * Keys the AES can be pointed at. Switching slots only swaps the key pointer
+ * handed to the HAL, the registers are written on the next operation.
+ */
+typedef enum
+{
+	KEYSLOT_NETWORK = 0,   // Frame key derived from the team key.
+	KEYSLOT_PAIRING = 1,   // Key derived from a Curve25519 shared secret.
+	KEYSLOT_PREVIOUS = 2,  // Frame key of the last epoch, kept for a grace period.
+	KEYSLOT_SCRATCH = 3,   // Whatever key is needed once, by key derivation.
+	KEYSLOT_COUNT
+} keyslot_t;
+
+#define KEYSLOT_NONE 0xFF
+
+// Longest a DMA pass through the AES may take before it is torn down, in ms.
+#ifndef KEYSLOT_DMA_TIMEOUT
+#define KEYSLOT_DMA_TIMEOUT 2
+#endif
+
+
+/**
+ *  Global Functions
+ */
+void keyslot_init();
+void keyslot_set(uint8_t slot, const void *key);
+HAL_StatusTypeDef keyslot_use(uint8_t slot, uint32_t algorithm, uint32_t *iv,
+		uint32_t *header, uint32_t headerSize);
+uint16_t keyslot_generation(uint8_t slot);
+HAL_StatusTypeDef keyslot_run(uint32_t *input, uint16_t length,
+		uint32_t *output);
@@ -0,0 +1,144 @@
+#include "link.h"
+#include "config.h"
+
+#include <string.h>
+
+// Indexed by device ID so every lookup is a single array access.
+static link_peer_t peers[256];
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+void link_init() {
+	memset(peers, 0, sizeof(peers));
+}
+
+/**
+ * Folds the SNR and RSSI of a frame the peer transmitted itself into its
+ * averages, called on RX done
+ */
+void link_observe(uint8_t deviceID, int8_t snr, int16_t rssi) {
+	link_peer_t *peer = &peers[deviceID];
+
+	if (!peer->valid) {
+		peer->snr = snr;
+		peer->rssi = rssi;
+		peer->valid = true;
+	} else {
+		peer->snr += (snr - peer->snr) / 8;
+		peer->rssi += (rssi - peer->rssi) / 8;
+	}
+	peer->lastSeen = HAL_GetTick();
+}
+
+/**
+ * Counts a record the peer sent first hand to one of our addresses, group
+ * says whether it went to our group. Sequence numbers it skipped since the
+ * last one are records we lost, but only once we know it is in our group:
+ * anyone else also numbers messages to a group we can't open.
+ */
+void link_record(uint8_t deviceID, uint32_t sequenceNumber, bool group) {
+	link_peer_t *peer = &peers[deviceID];
+
+	if (group) {
+		link_group(deviceID, DEVICE_GROUP);
+	}
+	if (sequenceNumber <= peer->lastSequence) {
+		return;
+	}
+	uint32_t lost = sequenceNumber - peer->lastSequence - 1;
+	if (link_inGroup(deviceID, DEVICE_GROUP) && peer->lastSequence != 0
+			&& lost <= LINK_GAP_MAX) {
+		for (uint32_t i = 0; i < lost; i++) {
+			peer->loss += (1000 - peer->loss) / 16;
+		}
+		peer->loss -= peer->loss / 16;
+	}
+	peer->lastSequence = sequenceNumber;
+}
+
+/**
+ * Counts one of our messages the master's bitmap says the peer did or did
+ * not acknowledge, so the loss follows what actually reaches it
+ */
+void link_delivery(uint8_t deviceID, bool delivered) {
+	link_peer_t *peer = &peers[deviceID];
+
+	if (delivered) {
+		peer->loss -= peer->loss / 16;
+	} else {
+		peer->loss += (1000 - peer->loss) / 16;
+	}
+}
+
+/**
+ * Notes the group a peer is in, as its ACKs or its messages to our group
+ * tell us
+ */
+void link_group(uint8_t deviceID, uint8_t group) {
+	peers[deviceID].group = group;
+	peers[deviceID].grouped = true;
+}
+
+/**
+ * True if the peer is known to be in the group, so it can open messages sent
+ * to it
+ */
+bool link_inGroup(uint8_t deviceID, uint8_t group) {
+	return peers[deviceID].grouped && peers[deviceID].group == group;
+}
+
+/**
+ * Statistics for a peer, or NULL if we never heard it
+ */
+const link_peer_t* link_peer(uint8_t deviceID) {
+	return peers[deviceID].lastSeen ? &peers[deviceID] : NULL;
+}
+
+/**
+ * Copies to send a message of the given class with, sized for the worst peer
+ * heard recently. A clean strong link gets one, each step down in margin or
+ * up in loss adds one, and every class above routine adds one more. Without
+ * recent statistics the configured count is used.
+ */
+uint8_t link_redundancy(uint8_t priority) {
+	uint32_t now = HAL_GetTick();
+	int16_t snr = INT16_MAX;
+	uint16_t loss = 0;
+	bool heard = false;
+
+	for (uint16_t i = 0; i < 256; i++) {
+		if (!peers[i].valid || now - peers[i].lastSeen > LINK_STALE) {
+			continue;
+		}
+		heard = true;
+		if (peers[i].snr < snr) {
+			snr = peers[i].snr;
+		}
+		if (peers[i].loss > loss) {
+			loss = peers[i].loss;
+		}
+	}
+
+	uint8_t copies;
+	if (!heard) {
+		copies = config.copies;
+	} else {
+		int16_t margin = (snr - LINK_SNR_FLOOR) / 4;
+		if (loss < 50 && margin >= 10) {
+			copies = 1;
+		} else if (loss < 150 && margin >= 5) {
+			copies = 2;
+		} else if (loss < 300) {
+			copies = 3;
+		} else {
+			copies = 4;
+		}
+	}
+
+	copies += priority;
+	return copies > LINK_MAX_COPIES ? LINK_MAX_COPIES : copies;
+}
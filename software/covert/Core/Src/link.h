@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Statistics older than this say nothing about the link any more, in ms.
+#ifndef LINK_STALE
+#define LINK_STALE 60000
+#endif
+
+// Lowest SNR the modem still demodulates at SF9, in 0.25 dB.
+#ifndef LINK_SNR_FLOOR
+#define LINK_SNR_FLOOR -50
+#endif
+
+#ifndef LINK_MAX_COPIES
+#define LINK_MAX_COPIES 4
+#endif
+
+// Longer sequence gaps are a reboot or a window jump, not loss.
+#ifndef LINK_GAP_MAX
+#define LINK_GAP_MAX 16
+#endif
+
+
+/**
+ * How well we hear one peer: smoothed SNR in 0.25 dB and RSSI in dBm of the
+ * frames it sent itself, the share of records lost between us in per mille
+ * (its records we missed and our messages it did not acknowledge), when we
+ * last heard from it and, once we know, the group it is in.
+ */
+typedef struct {
+	int16_t snr;
+	int16_t rssi;
+	uint16_t loss;
+	bool valid;
+	uint32_t lastSeen;
+	uint32_t lastSequence;
+	bool grouped;        // group below is known
+	uint8_t group;
+} link_peer_t;
+
+
+/**
+ *  Global Functions
+ */
+void link_init();
+void link_observe(uint8_t deviceID, int8_t snr, int16_t rssi);
+void link_record(uint8_t deviceID, uint32_t sequenceNumber, bool group);
+void link_delivery(uint8_t deviceID, bool delivered);
+void link_group(uint8_t deviceID, uint8_t group);
+bool link_inGroup(uint8_t deviceID, uint8_t group);
+const link_peer_t* link_peer(uint8_t deviceID);
+uint8_t link_redundancy(uint8_t priority);
@@ -0,0 +1,304 @@
+#include "mac.h"
+#include "rfm95.h"
+#include "entropy.h"
+#include "airtime.h"
+#include "txqueue.h"
+
+#include <string.h>
+
+static mac_peer_t roster[TDMA_MAX_SLOTS - 2];
+static uint8_t rosterCount = 0;
+
+// Schedule from the last beacon sent (master) or heard (slave).
+static volatile uint32_t beaconTick = 0;
+static volatile bool beaconValid = false;
+static volatile int8_t mySlot = -1;
+static volatile bool slotShared = false;
+static volatile uint16_t slotLength = 0;
+static volatile uint8_t slotCount = 0;
+
+// Slave: the beacon our next presence record acknowledges.
+static volatile uint8_t beaconSender = 0;
+static volatile uint32_t beaconSequence = 0;
+static volatile uint32_t lastPresence = 0;
+static volatile bool presencePending = false;
+
+/**
+ * Private Function Definitions
+ */
+static uint32_t mac_period();
+static uint8_t mac_slotUnits();
+static bool mac_exclusiveSlot();
+static uint32_t mac_backoff(uint8_t exponent);
+static void mac_waitTxDone();
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Forgets the roster and any schedule heard so far
+ */
+void mac_init() {
+	memset(roster, 0, sizeof(roster));
+	rosterCount = 0;
+	beaconValid = false;
+	mySlot = -1;
+	slotShared = false;
+}
+
+/**
+ * Master side: remembers a device we heard so it gets a slot in the next beacon
+ */
+void mac_notePeer(uint8_t deviceID) {
+	if (deviceID == DEVICE_ID) {
+		return;
+	}
+	for (uint8_t i = 0; i < rosterCount; i++) {
+		if (roster[i].deviceID == deviceID) {
+			roster[i].lastHeard = HAL_GetTick();
+			return;
+		}
+	}
+	if (rosterCount < sizeof(roster) / sizeof(roster[0])) {
+		roster[rosterCount].deviceID = deviceID;
+		roster[rosterCount].lastHeard = HAL_GetTick();
+		rosterCount++;
+	}
+}
+
+/**
+ * Master side: true once the current superframe is over
+ */
+bool mac_beaconDue() {
+	if (!TDMA_MODE || !MASTER_DEVICE) {
+		return false;
+	}
+	return !beaconValid || HAL_GetTick() - beaconTick >= mac_period();
+}
+
+/**
+ * Master side: lays out slot 0 for ourselves, one slot per live peer and a
+ * final contention slot for devices that have not been assigned yet
+ */
+void mac_buildBeacon(BeaconPacket *beacon) {
+	uint32_t now = HAL_GetTick();
+
+	__disable_irq();
+	for (uint8_t i = 0; i < rosterCount;) {
+		if (now - roster[i].lastHeard > TDMA_PEER_TIMEOUT) {
+			roster[i] = roster[--rosterCount];
+		} else {
+			i++;
+		}
+	}
+
+	memset(beacon, 0, sizeof(BeaconPacket));
+	beacon->preamble = BEACON_PREAMBLE;
+	beacon->deviceID = DEVICE_ID;
+
+	uint8_t count = 0;
+	beacon->slotOwners[count++] = DEVICE_ID;
+	for (uint8_t i = 0; i < rosterCount; i++) {
+		beacon->slotOwners[count++] = roster[i].deviceID;
+	}
+	beacon->slotOwners[count++] = TDMA_SLOT_SHARED;
+	__enable_irq();
+
+	beacon->slotLength = mac_slotUnits();
+	beacon->slotCount = count;
+
+	mySlot = 0;
+	slotShared = false;
+	slotLength = beacon->slotLength * 10;
+	slotCount = count;
+}
+
+/**
+ * Master side: sends an already encrypted beacon and starts the superframe
+ * once it has left the antenna, which is when slaves timestamp it. MAC_BUSY
+ * if the radio did not take the frame; the beacon stays due and the main
+ * loop tries again on a later pass.
+ */
+mac_result_t mac_sendBeacon(uint8_t *frame, uint8_t length) {
+	if (!transmitPackage(frame, length)) {
+		return MAC_BUSY;
+	}
+
+	// the TX done is due after the frame's airtime, a missing one is not
+	// waited for much longer
+	uint32_t start = HAL_GetTick();
+	uint32_t timeout = airtime_frame(length) / 1000 + TDMA_GUARD;
+	while (!handle->txDone && HAL_GetTick() - start < timeout) {
+	}
+
+	beaconTick = handle->txDone ? handle->txTick : HAL_GetTick();
+	beaconValid = true;
+	return MAC_SENT;
+}
+
+/**
+ * Slave side: adopts the schedule from a decrypted beacon, called on RX done.
+ * The superframe is timed from the end of the beacon, as on the master.
+ */
+void mac_receiveBeacon(const BeaconPacket *beacon) {
+	if (MASTER_DEVICE) {
+		return;
+	}
+	// check in right away when we pick the schedule up again
+	if (!beaconValid) {
+		presencePending = true;
+	}
+	beaconSender = beacon->deviceID;
+	beaconSequence = beacon->sequenceNumber;
+
+	beaconTick = handle->rxTick;
+	slotLength = beacon->slotLength * 10;
+	slotCount = beacon->slotCount;
+	if (slotCount > TDMA_MAX_SLOTS) {
+		slotCount = TDMA_MAX_SLOTS;
+	}
+
+	mySlot = -1;
+	slotShared = false;
+	for (uint8_t i = 0; i < slotCount; i++) {
+		if (beacon->slotOwners[i] == DEVICE_ID) {
+			mySlot = i;
+			slotShared = false;
+			break;
+		}
+		if (beacon->slotOwners[i] == TDMA_SLOT_SHARED) {
+			mySlot = i;
+			slotShared = true;
+		}
+	}
+	beaconValid = slotLength > 0 && mySlot >= 0;
+}
+
+/**
+ * Slave side: true when it is time to acknowledge the latest beacon, which
+ * tells the master we are here. Returns the beacon to acknowledge.
+ */
+bool mac_presenceDue(uint8_t *master, uint32_t *sequenceNumber) {
+	if (!TDMA_MODE || MASTER_DEVICE || !beaconValid) {
+		return false;
+	}
+	if (!presencePending
+			&& HAL_GetTick() - lastPresence < MAC_PRESENCE_INTERVAL) {
+		return false;
+	}
+	presencePending = false;
+	lastPresence = HAL_GetTick();
+	*master = beaconSender;
+	*sequenceNumber = beaconSequence;
+	return true;
+}
+
+/**
+ * How long in ms until the current time falls inside our slot with room for a
+ * frame of length bytes, 0 if it does now. Without a recent beacon there is
+ * no schedule and the medium is free for all.
+ */
+uint32_t mac_slotWait(uint8_t length) {
+	if (!TDMA_MODE || !beaconValid) {
+		return 0;
+	}
+
+	uint32_t period = mac_period();
+	uint32_t sinceBeacon = HAL_GetTick() - beaconTick;
+
+	if (!MASTER_DEVICE && sinceBeacon > period * TDMA_BEACON_LOSS) {
+		beaconValid = false;
+		return 0;
+	}
+
+	uint32_t offset = sinceBeacon % period;
+	uint32_t start = TDMA_GUARD + mySlot * slotLength;
+	uint32_t end = start + slotLength;
+	// the whole frame has to be off the air before the next slot opens
+	uint32_t onAir = (airtime_frame(length) + 999) / 1000;
+
+	if (offset >= start && offset + onAir <= end) {
+		return 0;
+	}
+	return offset < start ? start - offset : period - offset + start;
+}
+
+/**
+ * Transmits an encrypted frame. Inside a slot the master gave us alone the
+ * frame goes straight out; otherwise CSMA/CA backs off for a random time and
+ * only sends once the channel is sensed idle. Outside our slot nothing is
+ * sent and nothing waits for it, the caller keeps the frame for later.
+ */
+mac_result_t mac_send(uint8_t *frame, uint8_t length) {
+	uint8_t exponent = CSMA_MIN_BE;
+
+	for (uint8_t attempt = 0; attempt < CSMA_MAX_TRIES; attempt++) {
+		if (!mac_exclusiveSlot()) {
+			HAL_Delay(mac_backoff(exponent));
+		}
+		if (mac_slotWait(length) > 0) {
+			return MAC_NOT_YET;
+		}
+		mac_waitTxDone();
+
+		if (!mac_exclusiveSlot() && rfm95_channelActivity()) {
+			if (exponent < CSMA_MAX_BE) {
+				exponent++;
+			}
+			continue;
+		}
+		if (transmitPackage(frame, length)) {
+			return MAC_SENT;
+		}
+	}
+	return MAC_BUSY;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static uint32_t mac_period() {
+	return TDMA_GUARD + (uint32_t) slotCount * slotLength;
+}
+
+/**
+ * Slot length in units of 10 ms: the configured one, or room for
+ * TDMA_SLOT_FRAMES of the largest frame we send
+ */
+static uint8_t mac_slotUnits() {
+	if (TDMA_SLOT_LENGTH > 0) {
+		return TDMA_SLOT_LENGTH;
+	}
+	uint32_t frame = (airtime_frame(FRAME_LENGTH(AGGREGATE_MAX)) + 999) / 1000;
+	uint32_t units = (TDMA_SLOT_FRAMES * (frame + TDMA_TURNAROUND) + 9) / 10;
+	return units > UINT8_MAX ? UINT8_MAX : units;
+}
+
+static bool mac_exclusiveSlot() {
+	return TDMA_MODE && beaconValid && !slotShared;
+}
+
+/**
+ * Random backoff in ms for the given exponent, from the entropy ring
+ */
+static uint32_t mac_backoff(uint8_t exponent) {
+	uint32_t random;
+	entropy_get(&random);
+	return (random & ((1u << exponent) - 1)) * CSMA_UNIT;
+}
+
+/**
+ * Waits for our own previous frame to finish so the channel check is not
+ * fooled by it
+ */
+static void mac_waitTxDone() {
+	uint32_t start = HAL_GetTick();
+	while (!handle->txDone && HAL_GetTick() - start < RFM95_SEND_TIMEOUT) {
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+#ifndef TDMA_MAX_SLOTS
+#define TDMA_MAX_SLOTS 8
+#endif
+
+// Slot length in units of 10 ms. 0 sizes it for TDMA_SLOT_FRAMES frames of
+// the largest aggregate.
+#ifndef TDMA_SLOT_LENGTH
+#define TDMA_SLOT_LENGTH 0
+#endif
+
+// Frames a device may send back to back in its slot: every copy of one
+// message at the highest redundancy.
+#ifndef TDMA_SLOT_FRAMES
+#define TDMA_SLOT_FRAMES 4
+#endif
+
+// Radio turnaround between two frames in a slot, in ms.
+#ifndef TDMA_TURNAROUND
+#define TDMA_TURNAROUND 10
+#endif
+
+// Quiet time after a beacon before the first slot opens, in ms.
+#ifndef TDMA_GUARD
+#define TDMA_GUARD 20
+#endif
+
+// Superframes a slave keeps using its slot without hearing a beacon.
+#ifndef TDMA_BEACON_LOSS
+#define TDMA_BEACON_LOSS 3
+#endif
+
+// A peer the master has not heard from for this long loses its slot.
+#ifndef TDMA_PEER_TIMEOUT
+#define TDMA_PEER_TIMEOUT 60000
+#endif
+
+// CSMA/CA: a random backoff of 0 to 2^BE - 1 units precedes each channel
+// check, and BE grows by one every time the channel is found busy.
+#ifndef CSMA_MIN_BE
+#define CSMA_MIN_BE 2
+#endif
+
+#ifndef CSMA_MAX_BE
+#define CSMA_MAX_BE 6
+#endif
+
+#ifndef CSMA_MAX_TRIES
+#define CSMA_MAX_TRIES 6
+#endif
+
+// Backoff unit in ms, about one CAD cycle plus turnaround.
+#ifndef CSMA_UNIT
+#define CSMA_UNIT 10
+#endif
+
+// A slave that has the schedule checks in this often so the master keeps its
+// slot and knows it is in range, in ms.
+#ifndef MAC_PRESENCE_INTERVAL
+#define MAC_PRESENCE_INTERVAL 5000
+#endif
+
+// Slot owner marking the contention slot left open for devices the master
+// has not assigned yet.
+#define TDMA_SLOT_SHARED 0xFF
+
+
+/**
+ * What became of a frame handed to mac_send.
+ */
+typedef enum
+{
+	MAC_SENT = 0,      // On its way.
+	MAC_NOT_YET = 1,   // Our slot is not open, try again later.
+	MAC_BUSY = 2,      // The channel stayed busy for every attempt.
+} mac_result_t;
+
+/**
+ * A device the master hands a slot to.
+ */
+typedef struct {
+	uint8_t deviceID;
+	uint32_t lastHeard;
+} mac_peer_t;
+
+
+/**
+ *  Global Functions
+ */
+void mac_init();
+void mac_notePeer(uint8_t deviceID);
+bool mac_beaconDue();
+void mac_buildBeacon(BeaconPacket *beacon);
+mac_result_t mac_sendBeacon(uint8_t *frame, uint8_t length);
+void mac_receiveBeacon(const BeaconPacket *beacon);
+bool mac_presenceDue(uint8_t *master, uint32_t *sequenceNumber);
+uint32_t mac_slotWait(uint8_t length);
+mac_result_t mac_send(uint8_t *frame, uint8_t length);
@@ -24,62 +24,145 @@
 /* USER CODE BEGIN Includes */
 #include <string.h>
 #include <assert.h>
-#include "crypto.h"
 #include "rfm95.h"
+#include "relay.h"
+#include "mac.h"
+#include "txqueue.h"
+#include "timesync.h"
+#include "codebook.h"
+#include "config.h"
+#include "bulk.h"
+#include "link.h"
+#include "airtime.h"
+#include "saf.h"
+#include "ack.h"
+#include "keyslot.h"
+#include "gcm.h"
+#include "pairkey.h"
+#include "x25519.h"
+#include "groupkey.h"
+#include "kdf.h"
+#include "entropy.h"
 
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-typedef struct {
-	uint32_t privateKey[8];
-	uint8_t publicKey[32];
-	uint8_t otherPublicKey[32];
-	uint8_t sharedSecret[32];
-	volatile uint8_t gotOther;
-	volatile uint8_t masterSent;
-	volatile uint8_t pairing;
-} AsymmetricKeys;
-
 typedef struct {
 	volatile uint8_t enabled;
 	uint8_t count;
 	uint64_t data;
+	uint8_t priority;
+	uint32_t start;
+	volatile uint8_t waiting;
 } Record;
 
+// HELLO and the open half of PAIR_KEY: the sender's public key, and the
+// device the frame is about (the slave in both)
 typedef struct __attribute__((__packed__)) {
 	uint8_t preamble;
 	uint8_t deviceID;
-	uint32_t sequenceNumber;
-	uint64_t data;
-	uint16_t _placeholder;
-} Packet;
-
-typedef struct __attribute__((__packed__)) {
-	uint8_t preamble;
 	uint8_t data[32];
 } PublicKeyPacket;
 
 typedef struct __attribute__((__packed__)) {
 	uint8_t preamble;
+	uint8_t epoch;
 	uint8_t data[16];
 } KeyExchangePacket;
 
+typedef enum {
+	PAIRING_IDLE = 0,
+	PAIRING_START,      // pair button pressed, main loop picks it up
+	PAIRING_KEYGEN,     // working out our public key in slices
+	PAIRING_HELLO,      // slave: sending HELLO until a PAIR_KEY answers
+	PAIRING_LISTEN,     // master: enrolling everyone who says hello
+	PAIRING_SECRET,     // slave: working out the shared secret in slices
+	PAIRING_CONFIRM,    // slave: paired, answering repeats of the PAIR_KEY
+} PairingState;
+
+typedef enum {
+	PAIRING_PENDING = 0,
+	PAIRING_SUCCEEDED,
+	PAIRING_FAILED,
+} PairingResult;
+
+// Keys derived from a Curve25519 shared secret, one per direction
+typedef struct {
+	uint32_t down[4];   // master to slave: PAIR_KEY
+	uint32_t up[4];     // slave to master: CONFIRM
+} PairingKeys;
+
+// Master: one device enrolling in the current session
+typedef enum {
+	JOINER_FREE = 0,
+	JOINER_HEARD,       // HELLO in, shared secret still to work out
+	JOINER_SENT,        // PAIR_KEY out, waiting for CONFIRM
+	JOINER_DONE,
+	JOINER_FAILED,
+} JoinerState;
+
+typedef struct {
+	volatile uint8_t state;
+	uint8_t deviceID;
+	uint8_t publicKey[32];
+	PairingKeys keys;
+	uint8_t sent;
+	uint32_t due;
+	volatile uint8_t gotConfirm;
+	uint8_t confirm[sizeof(FrameHeader) + sizeof(KeyExchangePacket)
+			+ FRAME_TAG_LENGTH];
+} Joiner;
+
+typedef struct {
+	uint32_t privateKey[8];
+	uint8_t publicKey[32];
+	uint8_t otherPublicKey[32];
+	PairingKeys keys;   // slave
+	// slave: the sealed half of the PAIR_KEY
+	uint8_t sealed[sizeof(FrameHeader) + sizeof(KeyExchangePacket)
+			+ FRAME_TAG_LENGTH];
+	volatile uint8_t state;
+	volatile uint8_t gotOther;   // slave: a PAIR_KEY is waiting
+	volatile uint8_t repeated;   // slave: the master sent its PAIR_KEY again
+	int8_t computing;            // master: joiner the ladder works for, or -1
+	uint8_t result;
+	uint32_t due;       // tick the next frame goes out
+	uint32_t deadline;  // tick the current state gives up
+	x25519_t ladder;
+} AsymmetricKeys;
+
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
 
-#define MASTER_DEVICE 	0
-#define DEVICE_ID 		1
 #define RESET 			0
 #define NEW_SEQ			0
+#define SEQ_WINDOW		2000
 
 #define AESKeySize 128/8 //(8 * sizeof(uint32_t));
-#define PUBLIC_EXCHANGE_PREAMBLE 0b01010101
+#define PAIR_HELLO_PREAMBLE 0b01010101
+#define PAIR_KEY_PREAMBLE 0b00110011
+#define PAIR_CONFIRM_PREAMBLE 0b10100101
 #define AES_KEY_EXCHANGE_PREAMBLE 0b10101010
-#define VIBE_PREAMBLE 0b11110000
-#define DUTY_CYCLE_ON 10
+#define ADDRESS_TAG_PREAMBLE 0b00111100
+// A whole session gives up after this long, in ms. The master enrols
+// whoever says hello until then.
+#define PAIRING_TIMEOUT 20000
+#define PAIRING_MAX_JOINERS 8
+// Time to wait for an answer before sending again, about one HELLO, one
+// PAIR_KEY and one shared secret, in ms
+#define PAIRING_RETRY_TIME 700
+#define PAIRING_RETRIES 8
+// A paired slave still answers repeated PAIR_KEYs for this long, in ms
+#define PAIRING_LINGER 3000
+// The result shows on LED2 for this long, in ms
+#define PAIRING_RESULT_TIME 2000
+// Longest the main loop spends on Curve25519 per pass, in ms
+#define PAIRING_SLICE_TIME 5
+#define KEY_EXCHANGE_FRAME_LENGTH (sizeof(FrameHeader) + sizeof(KeyExchangePacket) + FRAME_TAG_LENGTH)
+#define PAIR_KEY_FRAME_LENGTH (sizeof(PublicKeyPacket) + KEY_EXCHANGE_FRAME_LENGTH)
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -89,6 +172,8 @@ typedef struct __attribute__((__packed__)) {
 
 /* Private variables ---------------------------------------------------------*/
 CRYP_HandleTypeDef hcryp;
+DMA_HandleTypeDef hdma_aes_in;
+DMA_HandleTypeDef hdma_aes_out;
 uint32_t pKeyAES[4] __ALIGN_END = { 0x00000000,
 		0x00000000, 0x00000000, 0x00000000 };
 __ALIGN_BEGIN static const uint32_t pInitVectAES[4] __ALIGN_END = { 0x5B841799,
@@ -99,6 +184,8 @@ CRC_HandleTypeDef hcrc;
 RNG_HandleTypeDef hrng;
 
 SPI_HandleTypeDef hspi1;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
 
 TIM_HandleTypeDef htim1;
 TIM_HandleTypeDef htim16;
@@ -109,16 +196,28 @@ FLASH_EraseInitTypeDef EraseSeqStruct;
 
 AsymmetricKeys aKeys;
 Record playback;
+Record queuedPlayback;
 Record recording;
-Packet outgoing;
 rfm95_handle_t radio;
 uint32_t deviceSeqs[256] = { 0 };
+uint32_t seqFloor = 0;
+// Nonce counter for the frames we seal, kept ahead in flash like seqFloor
+uint32_t frameCounter = 0;
+uint32_t frameFloor = 0;
+// Keyed tags we answer to: broadcast, our group and our device ID
+uint16_t addressTags[3] = { 0 };
+// The same under the previous epoch's key, during its grace period
+uint16_t previousTags[3] = { 0 };
+// A REKEY changed the key in the receive callback, flash is written later
+volatile uint8_t keyDirty = 0;
+Joiner joiners[PAIRING_MAX_JOINERS];
 
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_AES_Init(void);
 static void MX_RNG_Init(void);
 static void MX_CRC_Init(void);
@@ -126,11 +225,44 @@ static void MX_TIM16_Init(void);
 static void MX_TIM1_Init(void);
 static void MX_SPI1_Init(void);
 /* USER CODE BEGIN PFP */
-static void readKeyFromFlash(uint32_t *ptr, FLASH_EraseInitTypeDef *erase);
-static void writeKeyToFlash(uint64_t *ptr, FLASH_EraseInitTypeDef *erase);
-static uint32_t readSeqFromFlash(FLASH_EraseInitTypeDef *erase);
-static void writeSeqToFlash(uint32_t seq, FLASH_EraseInitTypeDef *erase);
+static uint8_t readKeyFromFlash(uint32_t *ptr, FLASH_EraseInitTypeDef *erase);
+static void writeKeyToFlash(uint64_t *ptr, uint8_t epoch,
+		FLASH_EraseInitTypeDef *erase);
+static uint32_t readSeqFromFlash(FLASH_EraseInitTypeDef *erase,
+		uint32_t *frames);
+static void writeSeqToFlash(uint32_t seq, uint32_t frames,
+		FLASH_EraseInitTypeDef *erase);
 static void readingCallback(uint8_t *buffer, uint8_t length);
+static bool receivePairing(const uint8_t *buffer, uint8_t length);
+static bool pairingStep(void);
+static bool pairingSlice(void);
+static bool enrolJoiners(uint32_t now);
+static Joiner* findJoiner(uint8_t deviceID);
+static void pairingDone(bool success);
+static bool derivePairingKeys(uint8_t slaveID, PairingKeys *keys);
+static void sendPairing(uint8_t preamble, uint8_t deviceID,
+		const uint32_t *key);
+static bool openPairing(const uint8_t *frame, uint8_t preamble,
+		const uint32_t *key, KeyExchangePacket *packet);
+static void rotateNetworkKey(void);
+static bool sendRekey(void);
+static void receiveRekey(const RekeyPacket *rekey, uint8_t slot);
+static void receiveRecord(Packet *record, const FrameHeader *header,
+		int8_t mode);
+static bool sendFrame(void);
+static void requeueFrame(const Packet *records, uint8_t count,
+		const FrameHeader *header, uint8_t copies, uint32_t queued);
+static uint32_t sendBeacon(void);
+static void queueRecording(int16_t code);
+static void queueAck(uint8_t sender, uint32_t sequenceNumber);
+static void startPlayback(uint64_t data, uint8_t priority, uint8_t playAt);
+static uint16_t encryptFrame(uint8_t slot, FrameHeader *header,
+		const void *payload, uint16_t length, uint8_t *frame);
+static uint16_t decryptFrame(uint8_t slot, const uint8_t *frame,
+		uint8_t length, FrameHeader *header, void *payload);
+static uint16_t addressTag(uint8_t slot, uint8_t mode, uint8_t id);
+static void refreshAddressTags(void);
+static int8_t addressMode(const FrameHeader *header, uint8_t slot);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -162,8 +294,15 @@ int main(void) {
 	/* USER CODE BEGIN SysInit */
 	uint8_t testing = sizeof(Packet);
 	assert(
-			sizeof(PublicKeyPacket) == 33 && sizeof(KeyExchangePacket) == 17
-					&& sizeof(Packet) == 16);
+			sizeof(PublicKeyPacket) == 34 && sizeof(KeyExchangePacket) == 18
+					&& sizeof(Packet) == 16 && sizeof(BeaconPacket) == 16
+					&& sizeof(SyncPacket) == 16 && sizeof(CodePacket) == 16
+					&& sizeof(BulkOfferPacket) == 16
+					&& sizeof(BulkChunkPacket) == 16
+					&& sizeof(BulkStatusPacket) == 16
+					&& sizeof(AckPacket) == 16
+					&& sizeof(AckBitmapPacket) == 16
+					&& sizeof(RekeyPacket) == 16);
 	// Key writing to flash
 	EraseInitStruct.Banks = FLASH_BANK_1;
 	EraseInitStruct.TypeErase = FLASH_TYPEERASE_PAGES;
@@ -178,6 +317,7 @@ int main(void) {
 
 	recording.enabled = 0;
 	playback.enabled = 0;
+	queuedPlayback.enabled = 0;
 
 	radio.spi_handle = &hspi1;
 
@@ -187,21 +327,32 @@ int main(void) {
 	radio.nrst_pin = RADIO_RESET_Pin;
 	radio.irq_port = RADIO_INT_GPIO_Port;
 	radio.irq_pin = RADIO_INT_Pin;
+	radio.irq_line = RADIO_INT_EXTI_IRQn;
 
 	radio.txDone = true;
 	radio.rxDoneCallback = readingCallback;
 
+	aKeys.state = PAIRING_IDLE;
 	aKeys.gotOther = 0;
-	aKeys.pairing = 0;
-	aKeys.masterSent = 0;
-	aKeys.sharedSecret[0] = 0;
 
-	outgoing.data = 0;
+	relay_init();
+	mac_init();
+	txqueue_init();
+	timesync_init();
+	codebook_init();
+	bulk_init();
+	link_init();
+	airtime_init();
+	saf_init();
+	ack_init();
+	keyslot_init();
+	gcm_init();
 
 	/* USER CODE END SysInit */
 
 	/* Initialize all configured peripherals */
 	MX_GPIO_Init();
+	MX_DMA_Init();
 	MX_AES_Init();
 	MX_RNG_Init();
 	MX_CRC_Init();
@@ -209,6 +360,8 @@ int main(void) {
 	MX_TIM1_Init();
 	MX_SPI1_Init();
 	/* USER CODE BEGIN 2 */
+	// the ring fills while the radio settles
+	entropy_init();
 
 	HAL_Delay(100);
 	if (!rfm95_init(&radio)) {
@@ -223,127 +376,191 @@ int main(void) {
 	HAL_TIM_Base_Start_IT(&htim16);
 	HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1);
 
-	readKeyFromFlash(pKeyAES, &EraseInitStruct);
+	config_init();
+	if (MASTER_DEVICE) {
+		config_blob_t blob;
+		uint16_t length = config_export(&blob);
+		bulk_source(&blob, length, config_version());
+	}
+
+	uint8_t epoch = readKeyFromFlash(pKeyAES, &EraseInitStruct);
 	// We lost our random key or we want a reset?
 	if (RESET || pKeyAES[0] == 0 || pKeyAES[0] == UINT32_MAX) {
 		uint64_t tmp[2];
-		for (int i = 0; i < 2; i++) {
-			if (HAL_RNG_GenerateRandomNumber(&hrng, &tmp[i]) != HAL_OK)
-				Error_Handler();
-			tmp[i] <<= 32;
-			if (HAL_RNG_GenerateRandomNumber(&hrng, &tmp[i]) != HAL_OK)
-				Error_Handler();
-		}
-		writeKeyToFlash(tmp, &EraseInitStruct);
-		readKeyFromFlash(pKeyAES, &EraseInitStruct);
+		if (!entropy_fill((uint32_t*) tmp, 4))
+			Error_Handler();
+		writeKeyToFlash(tmp, 0, &EraseInitStruct);
+		epoch = readKeyFromFlash(pKeyAES, &EraseInitStruct);
 	}
-	MX_AES_Init();
+	if (!groupkey_init(pKeyAES, epoch)) {
+		Error_Handler();
+	}
+	refreshAddressTags();
 
-	// Generate a random sequence number for packets -- assume 2000 is the most packets we'll ever send while devices haven't rebooted
-	deviceSeqs[DEVICE_ID] = readSeqFromFlash(&EraseSeqStruct);
+	// Generate a random sequence number for packets -- skip SEQ_WINDOW past the last stored value, which the main loop keeps ahead of what we've sent
+	deviceSeqs[DEVICE_ID] = readSeqFromFlash(&EraseSeqStruct, &frameCounter);
 	if (NEW_SEQ || deviceSeqs[DEVICE_ID] >= ((UINT32_MAX) >> 1)
 			|| deviceSeqs[DEVICE_ID] == 0) {
 		uint32_t seq = 0;
-		HAL_RNG_GenerateRandomNumber(&hrng, &seq);
+		if (!entropy_fill(&seq, 1))
+			Error_Handler();
 		seq >>= 1;
 		deviceSeqs[DEVICE_ID] = seq;
 	}
-	deviceSeqs[DEVICE_ID] += 2000;
-	writeSeqToFlash(deviceSeqs[DEVICE_ID], &EraseSeqStruct);
-
-	// Might as well generate a public key in advance
-	for (int i = 0; i < 8; i++) {
-		HAL_RNG_GenerateRandomNumber(&hrng, &aKeys.privateKey[i]);
+	// a GCM nonce must never come round again under the same key, so the
+	// frame counter gets the same treatment
+	if (NEW_SEQ || frameCounter >= ((UINT32_MAX) >> 1) || frameCounter == 0) {
+		if (!entropy_fill(&frameCounter, 1))
+			Error_Handler();
+		frameCounter >>= 1;
 	}
-	C25519keyGen((uint8_t*) aKeys.privateKey, aKeys.publicKey);
+	deviceSeqs[DEVICE_ID] += SEQ_WINDOW;
+	frameCounter += SEQ_WINDOW;
+	seqFloor = deviceSeqs[DEVICE_ID];
+	frameFloor = frameCounter;
+	writeSeqToFlash(seqFloor, frameFloor, &EraseSeqStruct);
+
+	// The Curve25519 keypair is only looked at when pairing starts
+	pairkey_init();
 
 	/* USER CODE END 2 */
 
 	/* Infinite loop */
 	/* USER CODE BEGIN WHILE */
 	while (1) {
-		if (aKeys.pairing && aKeys.pairing++ <= 5) {
-			// send our public key in plaintext.
-			PublicKeyPacket tmp;
-			tmp.preamble = PUBLIC_EXCHANGE_PREAMBLE;
-			memcpy(tmp.data, aKeys.publicKey, sizeof(tmp.data));
-			transmitPackage(&tmp, sizeof(PublicKeyPacket));
-			// randomize the delay here
-			uint32_t randoffset = 0;
-			HAL_RNG_GenerateRandomNumber(&hrng, &randoffset);
-
-			HAL_Delay(1000 + (randoffset & 0x7ff));
-			continue;
-		} else {
-			aKeys.pairing = 0;
+		// pairing runs alongside messaging, a slice of Curve25519 at a time
+		bool pairingBusy = pairingStep();
+
+		// Beacons burn through sequence numbers and every frame through the
+		// frame counter, so move the windows stored in flash forward before
+		// the next boot could reuse any of them
+		if (deviceSeqs[DEVICE_ID] - seqFloor >= SEQ_WINDOW / 2
+				|| frameCounter - frameFloor >= SEQ_WINDOW / 2) {
+			seqFloor = deviceSeqs[DEVICE_ID];
+			frameFloor = frameCounter;
+			writeSeqToFlash(seqFloor, frameFloor, &EraseSeqStruct);
 		}
 
-		if (aKeys.gotOther) {
-			C25519keyExchange(aKeys.sharedSecret, (uint8_t*) aKeys.privateKey,
-					aKeys.otherPublicKey);
-//			rfm95_init(&radio);
-			aKeys.gotOther = 0;
-			aKeys.masterSent = 1;
-		}
-
-		if (aKeys.masterSent && aKeys.masterSent++ <= 10) {
-			if (MASTER_DEVICE) {
-				// Save the "master's secret key" in old pkeys
-				uint32_t oldPkeys[4] = { 0 };
-				memcpy(oldPkeys, pKeyAES, AESKeySize);
-				// move the shared secret to the AES hardware for encryption
-				memcpy(pKeyAES, aKeys.sharedSecret, AESKeySize);
-				MX_AES_Init();
-				// Create a packet & attack the "master's key"
-				KeyExchangePacket tmp;
-				tmp.preamble = AES_KEY_EXCHANGE_PREAMBLE;
-				memcpy(tmp.data, oldPkeys, AESKeySize);
-
-				// Output the encrypted packet in a buffer
-				uint8_t inputBuf[32] = { 0 };
-				memcpy(inputBuf, &tmp, sizeof(KeyExchangePacket));
-				uint8_t outputBuf[32] = { 0 };
-
-				if (HAL_CRYP_Encrypt(&hcryp, inputBuf, 32, outputBuf, 1)
-						== HAL_OK) {
-					transmitPackage(outputBuf, 32);
-				}
-				memcpy(pKeyAES, oldPkeys, AESKeySize);
-				MX_AES_Init();
+		// the previous epoch's tags go when its grace period ends
+		bulk_process();
+		if (groupkey_poll()) {
+			refreshAddressTags();
+		}
+		if (keyDirty) {
+			keyDirty = 0;
+			writeKeyToFlash((uint64_t*) pKeyAES, groupkey_epoch(),
+					&EraseInitStruct);
+		}
+		// the master rotates the team key now and then and tells the others
+		// with REKEY frames sealed under the old one
+		if (groupkey_rotationDue()) {
+			rotateNetworkKey();
+		}
+		// a copy held back for airtime or the channel stays due
+		if (groupkey_copyDue() && sendRekey()) {
+			groupkey_copySent();
+		}
+		// the schedule hangs off the beacon, so nothing else goes while it
+		// waits for its budget
+		uint32_t beaconWait = 0;
+		if (mac_beaconDue()) {
+			beaconWait = sendBeacon();
+			if (beaconWait == 0) {
+				continue;
+			}
+		}
+
+		Packet relayed;
+		FrameHeader relayedHeader;
+		while (relay_poll(&relayed, &relayedHeader)) {
+			txqueue_push(&relayed, &relayedHeader, 1);
+		}
+		// slaves check in with the master every now and then
+		uint8_t master;
+		uint32_t beaconSequence;
+		if (mac_presenceDue(&master, &beaconSequence)) {
+			queueAck(master, beaconSequence);
+		}
+		// acknowledgements whose slot has come, the master's bitmaps of them
+		// and the retransmissions those call for
+		uint8_t ackedDevice;
+		uint32_t ackedSequence;
+		while (ack_poll(&ackedDevice, &ackedSequence)) {
+			queueAck(ackedDevice, ackedSequence);
+		}
+		AckBitmapPacket bitmap;
+		while (ack_pollBitmap(&bitmap)) {
+			if (bitmap.ackedDevice == DEVICE_ID) {
+				ack_receiveBitmap(&bitmap);
 			} else {
-				//we're a slave device and we can just sit and wait for master count to ++
+				Packet packet;
+				memcpy(&packet, &bitmap, sizeof(Packet));
+				FrameHeader bitmapHeader = { 0 };
+				bitmapHeader.address = addressTags[ADDRESS_BROADCAST];
+				txqueue_push(&packet, &bitmapHeader, 1);
 			}
-			HAL_GPIO_WritePin(LED1_GPIO_Port, LED1_Pin, GPIO_PIN_RESET);
-			HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_SET);
-			HAL_Delay(500);
-			HAL_GPIO_WritePin(LED1_GPIO_Port, LED1_Pin, GPIO_PIN_SET);
-			HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_RESET);
-			HAL_Delay(500);
-			continue;
-		} else {
-			aKeys.masterSent = 0;
-		}
-
-		if (outgoing.data) {
-			//encrypt and transmit the outgoing packet
-			uint32_t tempin[4] = { 0 };
-			uint32_t tempout[4] = { 0 };
-			memcpy(tempin, &outgoing, sizeof(Packet));
-			HAL_CRYP_Encrypt(&hcryp, (uint8_t*) tempin, 16, (uint8_t*) tempout,
-					1);
-			outgoing.data = 0;
-			for (uint8_t i = 0; i < 3; i++) {
-				while (!transmitPackage((uint8_t*) tempout, 16)) {
-					HAL_Delay(70);
-				}
+		}
+		Packet resend;
+		int16_t resendPeer;
+		uint8_t resendPriority;
+		while (ack_pollResend(&resend, &resendPeer, &resendPriority)) {
+			FrameHeader resendHeader = { 0 };
+			resendHeader.address =
+					resendPeer == ACK_RESEND_GROUP ?
+							addressTags[ADDRESS_GROUP] :
+							addressTag(KEYSLOT_NETWORK, ADDRESS_UNICAST,
+									resendPeer);
+			resendHeader.flags = resendPriority << FRAME_PRIORITY_SHIFT;
+			txqueue_push(&resend, &resendHeader, 1);
+		}
+		// hand the master's held messages to members that came back
+		Packet held;
+		uint8_t heldPeer;
+		uint8_t heldPriority;
+		for (uint8_t i = 0;
+				i < AGGREGATE_MAX && saf_poll(&held, &heldPeer, &heldPriority);
+				i++) {
+			FrameHeader heldHeader = { 0 };
+			heldHeader.address = addressTag(KEYSLOT_NETWORK, ADDRESS_UNICAST,
+					heldPeer);
+			heldHeader.flags = heldPriority << FRAME_PRIORITY_SHIFT;
+			txqueue_push(&held, &heldHeader, 1);
+		}
+		// config distribution only uses the air nobody else needs
+		if (txqueue_empty()) {
+			Packet bulk;
+			FrameHeader bulkHeader = { 0 };
+			bulkHeader.address = addressTags[ADDRESS_BROADCAST];
+			for (uint8_t i = 0; i < AGGREGATE_MAX && bulk_poll(&bulk); i++) {
+				txqueue_push(&bulk, &bulkHeader, 1);
 			}
+		}
+
+		if (beaconWait == 0 && !txqueue_empty() && sendFrame()) {
 			continue;
 		}
 
+		// nothing to send: work out the keystreams the next frames will need
+		gcm_refill(frameCounter + 1);
+		// restart the RNG if a health check stopped it
+		entropy_poll();
+
 		HAL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
 
 //		HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_9);
-		HAL_Delay(250);
+		if (!pairingBusy) {
+			// frames waiting for our TDMA slot wake us when it opens
+			uint32_t idle = 250;
+			uint32_t slot =
+					txqueue_empty() ? 0 : mac_slotWait(FRAME_LENGTH(1));
+			if (slot > 0 && slot < idle) {
+				idle = slot;
+			}
+			if (beaconWait > 0 && beaconWait < idle) {
+				idle = beaconWait;
+			}
+			HAL_Delay(idle);
+		}
 		/* USER CODE END WHILE */
 
 		/* USER CODE BEGIN 3 */
@@ -431,6 +648,8 @@ static void MX_AES_Init(void) {
 		Error_Handler();
 	}
 	/* USER CODE BEGIN AES_Init 2 */
+	// keyslot_use decides when the key and IV have to be written again
+	hcryp.Init.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ONCE;
 	/* USER CODE END AES_Init 2 */
 
 }
@@ -627,6 +846,27 @@ static void MX_TIM16_Init(void) {
 
 }
 
+/**
+ * Enable DMA controller clock
+ */
+static void MX_DMA_Init(void) {
+
+	/* DMA controller clock enable */
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	/* DMA interrupt init */
+	/* DMA1_Channel1_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+	/* DMA1_Channel2_3_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Channel2_3_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+	/* DMA1_Ch4_7_DMAMUX1_OVR_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Ch4_7_DMAMUX1_OVR_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Ch4_7_DMAMUX1_OVR_IRQn);
+
+}
+
 /**
  * @brief GPIO Initialization Function
  * @param None
@@ -706,18 +946,26 @@ void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin) {
 //		HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_SET);
 //	}
 
-	if (recording.enabled || aKeys.pairing) {
+	if (recording.enabled && GPIO_Pin == PAIR_Pin) {
+		// pair button while recording raises the message's priority class
+		if (recording.priority < PRIORITY_EMERGENCY) {
+			recording.priority++;
+		}
+		return;
+	}
+	if (recording.enabled || aKeys.state != PAIRING_IDLE) {
 		return;
 	}
 	if (GPIO_Pin == PAIR_Pin) {
 		// in actual pairing
-		aKeys.pairing = 1;
+		aKeys.state = PAIRING_START;
 
 	} else if (GPIO_Pin == VIBE_BUTTON_Pin) {
 		// on vibe button:
 		recording.enabled = 1;
 		recording.count = 1;
 		recording.data = 1;
+		recording.priority = PRIORITY_ROUTINE;
 	}
 }
 
@@ -733,7 +981,7 @@ void HAL_GPIO_EXTI_Rising_Callback(uint16_t GPIO_Pin) {
 }
 
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
-	if (aKeys.pairing) {
+	if (aKeys.state != PAIRING_IDLE && aKeys.result == PAIRING_PENDING) {
 		HAL_GPIO_TogglePin(LED2_GPIO_Port, LED2_Pin);
 	}
 //	if (aKeys.masterSent) {
@@ -742,11 +990,11 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
 
 	if (htim == &htim16 && (recording.enabled || playback.enabled)) {
 
-		if (playback.enabled) {
+		if (playback.enabled && !playback.waiting) {
 			uint64_t shifted = (playback.data >> (playback.count++));
 			uint8_t state = shifted & 1;
 
-			TIM1->CCR1 = state ? (DUTY_CYCLE_ON * UINT16_MAX) / 10 : 0;
+			TIM1->CCR1 = state ? (config.dutyCycle * UINT16_MAX) / 10 : 0;
 			HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin,
 					(state ? GPIO_PIN_SET : GPIO_PIN_RESET));
 
@@ -754,6 +1002,12 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
 				playback.enabled = 0;
 				HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_RESET);
 				TIM1->CCR1 = 0;
+
+				// a message held back by a more urgent one plays next
+				if (queuedPlayback.enabled) {
+					playback = queuedPlayback;
+					queuedPlayback.enabled = 0;
+				}
 			}
 		}
 
@@ -763,13 +1017,14 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
 							== GPIO_PIN_RESET ? 1 : 0);
 			uint64_t state = read << (recording.count++);
 			recording.data |= state;
-			if (recording.count >= sizeof(recording.data) * 8) {
-				// packet should be formed & sent here
-
-				outgoing.deviceID = DEVICE_ID;
-				outgoing.preamble = VIBE_PREAMBLE;
-				outgoing.sequenceNumber = ++deviceSeqs[DEVICE_ID];
-				outgoing.data = recording.data;
+			// a known code goes out as soon as it is complete
+			int16_t code = read ? CODEBOOK_NO_MATCH :
+					codebook_match(recording.data, recording.count);
+			if (code != CODEBOOK_NO_MATCH) {
+				queueRecording(code);
+				recording.enabled = 0;
+			} else if (recording.count >= sizeof(recording.data) * 8) {
+				queueRecording(CODEBOOK_NO_MATCH);
 
 				// replay on local device:
 //				playback.data = recording.data;
@@ -781,6 +1036,7 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
 					recording.enabled = 1;
 					recording.count = 1;
 					recording.data = 1;
+					recording.priority = PRIORITY_ROUTINE;
 				}
 
 			}
@@ -788,73 +1044,971 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
 	}
 }
 
+/**
+ * Starts a scheduled playback on the exact ms it is due
+ */
+void HAL_SYSTICK_Callback(void) {
+	if (playback.enabled && playback.waiting
+			&& (int32_t) (HAL_GetTick() - playback.start) >= 0) {
+		playback.waiting = 0;
+		// restart the bit clock so the first bit plays now rather than on the
+		// next TIM16 tick, up to 25 ms off on every device
+		HAL_TIM_GenerateEvent(&htim16, TIM_EVENTSOURCE_UPDATE);
+	}
+}
+
 static void readingCallback(uint8_t *buffer, uint8_t length) {
-	if (aKeys.pairing && length == sizeof(PublicKeyPacket)) {
-		PublicKeyPacket tmp;
-		tmp.preamble = 0;
-		memcpy(&tmp, buffer, length);
-		if (tmp.preamble == PUBLIC_EXCHANGE_PREAMBLE) {
-			memcpy(aKeys.otherPublicKey, tmp.data, 32);
+	if (receivePairing(buffer, length)) {
+		return;
+	} else if (length > sizeof(FrameHeader) + FRAME_TAG_LENGTH
+			&& (length - sizeof(FrameHeader) - FRAME_TAG_LENGTH)
+					% sizeof(Packet) == 0
+			&& length - sizeof(FrameHeader) - FRAME_TAG_LENGTH
+					<= AGGREGATE_MAX * sizeof(Packet)) {
+		FrameHeader header;
+		memcpy(&header, buffer, sizeof(FrameHeader));
+
+		// the epoch names the team key that sealed the frame, without one
+		// for it there is nothing we can do with it
+		uint8_t slot;
+		if (!groupkey_slot(FRAME_EPOCH(header.flags), &slot)) {
+			return;
+		}
+
+		// Frames for someone else are dropped here without touching the AES,
+		// unless we may have to relay them on
+		int8_t mode = addressMode(&header, slot);
+		if (mode == ADDRESS_NONE && !(RELAY_MODE && (header.flags & FRAME_FLAG_RELAY))) {
+			return;
+		}
+
+		// check the tag and decrypt the whole frame, usually with a keystream
+		// worked out before it arrived, then split it into its records
+		Packet records[AGGREGATE_MAX];
+		uint16_t payloadLength = decryptFrame(slot, buffer, length, &header,
+				records);
+		if (payloadLength == 0) {
+			return;
+		}
+		// the authenticated source is whoever transmitted this copy, which is
+		// the link the frame's SNR and RSSI describe
+		link_observe(header.source, radio.snr, radio.rssi);
+		if (payloadLength == 2 * sizeof(Packet)
+				&& records[0].preamble == REKEY_PREAMBLE) {
+			receiveRekey((const RekeyPacket*) records, slot);
+			return;
+		}
+		// whoever sealed this under the old key missed the REKEY
+		if (slot == KEYSLOT_PREVIOUS) {
+			groupkey_straggler();
+		}
+		for (uint8_t i = 0; i < payloadLength / sizeof(Packet); i++) {
+			receiveRecord(&records[i], &header, mode);
+		}
+	}
+}
+
+/**
+ * Picks the handshake frames out of what the radio hears. Their lengths are
+ * none a sealed frame of records can have. Returns true if the frame was one.
+ * Anything sealed is only queued here, the main loop opens it.
+ */
+static bool receivePairing(const uint8_t *buffer, uint8_t length) {
+	PublicKeyPacket open;
+
+	if (MASTER_DEVICE && aKeys.state == PAIRING_LISTEN
+			&& length == sizeof(PublicKeyPacket)
+			&& buffer[0] == PAIR_HELLO_PREAMBLE) {
+		memcpy(&open, buffer, sizeof(PublicKeyPacket));
+		if (findJoiner(open.deviceID) == NULL) {
+			for (uint8_t i = 0; i < PAIRING_MAX_JOINERS; i++) {
+				if (joiners[i].state == JOINER_FREE) {
+					joiners[i].deviceID = open.deviceID;
+					memcpy(joiners[i].publicKey, open.data, 32);
+					joiners[i].gotConfirm = 0;
+					joiners[i].state = JOINER_HEARD;
+					break;
+				}
+			}
+		}
+		return true;
+	}
+	if (!MASTER_DEVICE && length == PAIR_KEY_FRAME_LENGTH
+			&& buffer[0] == PAIR_KEY_PREAMBLE) {
+		memcpy(&open, buffer, sizeof(PublicKeyPacket));
+		if (open.deviceID != DEVICE_ID) {
+			// enrolling someone else in the same session
+		} else if (aKeys.state == PAIRING_HELLO && !aKeys.gotOther) {
+			memcpy(aKeys.otherPublicKey, open.data, 32);
+			memcpy(aKeys.sealed, buffer + sizeof(PublicKeyPacket),
+					KEY_EXCHANGE_FRAME_LENGTH);
 			aKeys.gotOther = 1;
+		} else if (aKeys.state == PAIRING_CONFIRM
+				&& memcmp(aKeys.otherPublicKey, open.data, 32) == 0) {
+			// our CONFIRM got lost
+			aKeys.repeated = 1;
+		}
+		return true;
+	}
+	if (MASTER_DEVICE && aKeys.state == PAIRING_LISTEN
+			&& length == KEY_EXCHANGE_FRAME_LENGTH) {
+		FrameHeader header;
+		memcpy(&header, buffer, sizeof(FrameHeader));
+		Joiner *joiner = findJoiner(header.source);
+		if (joiner != NULL && joiner->state == JOINER_SENT
+				&& !joiner->gotConfirm) {
+			memcpy(joiner->confirm, buffer, KEY_EXCHANGE_FRAME_LENGTH);
+			joiner->gotConfirm = 1;
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Moves the pairing handshake along without blocking:
+ *
+ *   slave                      master
+ *   HELLO (our public key) -->
+ *                          <-- PAIR_KEY (its public key, team key and epoch
+ *                              sealed under the shared secret)
+ *   CONFIRM (sealed)       -->
+ *
+ * Each side resends its frame if the answer is late, so a lost frame costs
+ * one retry interval rather than a whole session. The master keeps listening
+ * for the whole session and enrols every slave that says hello. At most
+ * PAIRING_SLICE_TIME goes to the Curve25519 ladder per call. Returns true
+ * while there is ladder work left, so the main loop comes back right away
+ * instead of idling.
+ */
+static bool pairingStep(void) {
+	uint32_t now = HAL_GetTick();
+
+	if (aKeys.state != PAIRING_IDLE && aKeys.state != PAIRING_START
+			&& (int32_t) (now - aKeys.deadline) >= 0) {
+		// a slave lingering after success has nothing left to report, a
+		// master did well if it enrolled anyone
+		bool success = aKeys.result == PAIRING_SUCCEEDED;
+		for (uint8_t i = 0; MASTER_DEVICE && i < PAIRING_MAX_JOINERS; i++) {
+			success |= joiners[i].state == JOINER_DONE;
+		}
+		pairingDone(success);
+		return false;
+	}
+
+	switch (aKeys.state) {
+	case PAIRING_IDLE:
+		if (aKeys.result != PAIRING_PENDING
+				&& (int32_t) (now - aKeys.due) >= 0) {
+			HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_RESET);
+			aKeys.result = PAIRING_PENDING;
+		}
+		return false;
+
+	case PAIRING_START:
+		aKeys.gotOther = 0;
+		aKeys.repeated = 0;
+		aKeys.computing = -1;
+		aKeys.result = PAIRING_PENDING;
+		aKeys.due = now;
+		aKeys.deadline = now + PAIRING_TIMEOUT;
+		memset(joiners, 0, sizeof(joiners));
+		switch (pairkey_acquire(aKeys.privateKey, aKeys.publicKey)) {
+		case PAIRKEY_READY:
+			aKeys.state = MASTER_DEVICE ? PAIRING_LISTEN : PAIRING_HELLO;
+			return false;
+		case PAIRKEY_FRESH:
+			x25519_start(&aKeys.ladder, (uint8_t*) aKeys.privateKey, NULL);
+			aKeys.state = PAIRING_KEYGEN;
+			return true;
+		default:
+			pairingDone(false);
+			return false;
+		}
+
+	case PAIRING_KEYGEN:
+		if (pairingSlice()) {
+			return true;
+		}
+		x25519_finish(&aKeys.ladder, aKeys.publicKey);
+		pairkey_store(aKeys.privateKey, aKeys.publicKey);
+		aKeys.state = MASTER_DEVICE ? PAIRING_LISTEN : PAIRING_HELLO;
+		return false;
+
+	case PAIRING_LISTEN:
+		return enrolJoiners(now);
+
+	case PAIRING_HELLO:
+		if (aKeys.gotOther) {
+			x25519_start(&aKeys.ladder, (uint8_t*) aKeys.privateKey,
+					aKeys.otherPublicKey);
+			aKeys.state = PAIRING_SECRET;
+			return true;
+		}
+		if ((int32_t) (now - aKeys.due) >= 0) {
+			uint32_t jitter;
+			entropy_get(&jitter);
+			sendPairing(PAIR_HELLO_PREAMBLE, DEVICE_ID, NULL);
+			aKeys.due = now + PAIRING_RETRY_TIME + (jitter & 0xFF);
+		}
+		return false;
+
+	case PAIRING_SECRET: {
+		if (pairingSlice()) {
+			return true;
 		}
-	} else if (!MASTER_DEVICE && length == 32 && aKeys.masterSent) {
-		// try to decrypt with shared secret
-		uint32_t oldPkeys[4] = { 0 };
-
-		memcpy(oldPkeys, pKeyAES, AESKeySize);
-		memcpy(pKeyAES, aKeys.sharedSecret, AESKeySize);
-		MX_AES_Init();
-
-		uint8_t decryptRes[32] = { 0 };
-		if (HAL_CRYP_Decrypt(&hcryp, buffer, length, decryptRes, 1) == HAL_OK) {
-			KeyExchangePacket tmp;
-			tmp.preamble = 0;
-			memcpy(&tmp, decryptRes, sizeof(decryptRes));
-			if (tmp.preamble == AES_KEY_EXCHANGE_PREAMBLE) {
-				writeKeyToFlash((uint64_t*) tmp.data, &EraseInitStruct);
-
-				memcpy(pKeyAES, tmp.data, AESKeySize);
-				// We don't necessarily have to have this here -- we can let it keep writing
-				aKeys.masterSent = 0;
+		KeyExchangePacket packet;
+		if (!derivePairingKeys(DEVICE_ID, &aKeys.keys)
+				|| !openPairing(aKeys.sealed, AES_KEY_EXCHANGE_PREAMBLE,
+						aKeys.keys.down, &packet)) {
+			// not sealed for us, keep saying hello
+			aKeys.gotOther = 0;
+			aKeys.state = PAIRING_HELLO;
+			return false;
+		}
+		memcpy(pKeyAES, packet.data, AESKeySize);
+		if (!groupkey_init(pKeyAES, packet.epoch)) {
+			pairingDone(false);
+			return false;
+		}
+		writeKeyToFlash((uint64_t*) packet.data, packet.epoch,
+				&EraseInitStruct);
+		refreshAddressTags();
+
+		sendPairing(PAIR_CONFIRM_PREAMBLE, DEVICE_ID, aKeys.keys.up);
+		aKeys.result = PAIRING_SUCCEEDED;
+		HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_SET);
+		aKeys.deadline = now + PAIRING_LINGER;
+		aKeys.state = PAIRING_CONFIRM;
+		return false;
+	}
+
+	case PAIRING_CONFIRM:
+		if (aKeys.repeated) {
+			aKeys.repeated = 0;
+			sendPairing(PAIR_CONFIRM_PREAMBLE, DEVICE_ID, aKeys.keys.up);
+		}
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+/**
+ * Master: works through everyone who said hello in this session. The ladder
+ * serves one joiner at a time while the PAIR_KEYs and CONFIRMs of the others
+ * go on. True while there is ladder work left.
+ */
+static bool enrolJoiners(uint32_t now) {
+	if (aKeys.computing < 0) {
+		for (uint8_t i = 0; i < PAIRING_MAX_JOINERS; i++) {
+			if (joiners[i].state == JOINER_HEARD) {
+				x25519_start(&aKeys.ladder, (uint8_t*) aKeys.privateKey,
+						joiners[i].publicKey);
+				aKeys.computing = i;
+				break;
 			}
+		}
+	}
+	if (aKeys.computing >= 0 && !pairingSlice()) {
+		Joiner *joiner = &joiners[aKeys.computing];
+		aKeys.computing = -1;
+		if (derivePairingKeys(joiner->deviceID, &joiner->keys)) {
+			joiner->sent = 0;
+			joiner->due = now;
+			joiner->state = JOINER_SENT;
 		} else {
-			memcpy(pKeyAES, oldPkeys, AESKeySize);
+			joiner->state = JOINER_FAILED;
 		}
-		MX_AES_Init();
-	} else if (length == sizeof(Packet)) {
-		Packet tmp;
-		tmp.preamble = 0;
-		if (HAL_CRYP_Decrypt(&hcryp, buffer, length, &tmp, 1) == HAL_OK
-				&& tmp.preamble == VIBE_PREAMBLE
-				&& tmp.sequenceNumber > deviceSeqs[tmp.deviceID]) {
+	}
 
-			playback.data = tmp.data;
-			playback.enabled = 1;
-			playback.count = 0;
-			deviceSeqs[tmp.deviceID] = tmp.sequenceNumber;
+	for (uint8_t i = 0; i < PAIRING_MAX_JOINERS; i++) {
+		Joiner *joiner = &joiners[i];
+		if (joiner->state != JOINER_SENT) {
+			continue;
+		}
+		if (joiner->gotConfirm) {
+			KeyExchangePacket packet;
+			if (openPairing(joiner->confirm, PAIR_CONFIRM_PREAMBLE,
+					joiner->keys.up, &packet)) {
+				joiner->state = JOINER_DONE;
+				continue;
+			}
+			joiner->gotConfirm = 0;
+		}
+		if ((int32_t) (now - joiner->due) >= 0) {
+			if (joiner->sent >= PAIRING_RETRIES) {
+				joiner->state = JOINER_FAILED;
+			} else {
+				sendPairing(PAIR_KEY_PREAMBLE, joiner->deviceID,
+						joiner->keys.down);
+				joiner->sent++;
+				joiner->due = now + PAIRING_RETRY_TIME;
+			}
+		}
+	}
+	return aKeys.computing >= 0;
+}
+
+static Joiner* findJoiner(uint8_t deviceID) {
+	for (uint8_t i = 0; i < PAIRING_MAX_JOINERS; i++) {
+		if (joiners[i].state != JOINER_FREE
+				&& joiners[i].deviceID == deviceID) {
+			return &joiners[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Ladder steps until it is done or the slice is used up. True if work is
+ * left.
+ */
+static bool pairingSlice(void) {
+	uint32_t start = HAL_GetTick();
 
+	while (HAL_GetTick() - start < PAIRING_SLICE_TIME) {
+		if (x25519_step(&aKeys.ladder)) {
+			return false;
 		}
 	}
+	return true;
 }
 
-static void readKeyFromFlash(uint32_t *ptr, FLASH_EraseInitTypeDef *erase) {
+/**
+ * Ends a session and shows how it went: LED2 stays lit for a while after a
+ * success and goes dark after a failure
+ */
+static void pairingDone(bool success) {
+	aKeys.state = PAIRING_IDLE;
+	aKeys.result = success ? PAIRING_SUCCEEDED : PAIRING_FAILED;
+	aKeys.due = HAL_GetTick() + PAIRING_RESULT_TIME;
+	HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin,
+			success ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+/**
+ * Finishes the ladder and turns the shared secret into one key for each
+ * direction, bound to the slave's device ID. The secret itself is never used
+ * as a key and does not outlive this call.
+ */
+static bool derivePairingKeys(uint8_t slaveID, PairingKeys *keys) {
+	uint8_t secret[32];
+	uint32_t prk[4];
+	bool derived;
+
+	x25519_finish(&aKeys.ladder, secret);
+	// the radio interrupt opens frames on the same AES
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	derived = kdf_extract(secret, sizeof(secret), prk)
+			&& kdf_expand(prk, KDF_LABEL_DOWN, slaveID, keys->down)
+			&& kdf_expand(prk, KDF_LABEL_UP, slaveID, keys->up);
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	memset(secret, 0, sizeof(secret));
+	memset(prk, 0, sizeof(prk));
+	return derived;
+}
+
+/**
+ * Sends one handshake frame about a slave. HELLO is our public key in the
+ * clear. PAIR_KEY adds the team key and its epoch sealed under the key for
+ * the master's direction, CONFIRM is only a preamble sealed under the key for
+ * the slave's to prove it got that far.
+ */
+static void sendPairing(uint8_t preamble, uint8_t deviceID,
+		const uint32_t *key) {
+	uint8_t frame[PAIR_KEY_FRAME_LENGTH];
+	uint16_t length = sizeof(PublicKeyPacket);
+	PublicKeyPacket open;
+	KeyExchangePacket sealed;
+
+	if (preamble == PAIR_CONFIRM_PREAMBLE) {
+		length = 0;
+	} else {
+		open.preamble = preamble;
+		open.deviceID = deviceID;
+		memcpy(open.data, aKeys.publicKey, sizeof(open.data));
+		memcpy(frame, &open, sizeof(PublicKeyPacket));
+	}
+	if (preamble != PAIR_HELLO_PREAMBLE) {
+		memset(&sealed, 0, sizeof(KeyExchangePacket));
+		if (preamble == PAIR_KEY_PREAMBLE) {
+			sealed.preamble = AES_KEY_EXCHANGE_PREAMBLE;
+			sealed.epoch = groupkey_epoch();
+			memcpy(sealed.data, pKeyAES, AESKeySize);
+		} else {
+			sealed.preamble = PAIR_CONFIRM_PREAMBLE;
+		}
+		FrameHeader header = { 0 };
+		keyslot_set(KEYSLOT_PAIRING, key);
+		uint16_t sealedLength = encryptFrame(KEYSLOT_PAIRING, &header, &sealed,
+				sizeof(KeyExchangePacket), frame + length);
+		if (sealedLength == 0) {
+			return;
+		}
+		length += sealedLength;
+	}
+	if (airtime_wait(AIRTIME_CONTROL, length) == 0
+			&& transmitPackage(frame, length)) {
+		airtime_charge(AIRTIME_CONTROL, length);
+	}
+}
+
+/**
+ * Opens a sealed handshake frame under one of the pairing keys
+ */
+static bool openPairing(const uint8_t *frame, uint8_t preamble,
+		const uint32_t *key, KeyExchangePacket *packet) {
+	FrameHeader header;
+	bool opened;
+
+	keyslot_set(KEYSLOT_PAIRING, key);
+	// the radio interrupt opens frames on the same AES
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	opened = decryptFrame(KEYSLOT_PAIRING, frame, KEY_EXCHANGE_FRAME_LENGTH,
+			&header, packet) == sizeof(KeyExchangePacket)
+			&& packet->preamble == preamble;
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	return opened;
+}
+
+/**
+ * Master: draws the next epoch's team key and moves to it. The REKEY copies
+ * that carry it to everyone else follow from the main loop.
+ */
+static void rotateNetworkKey(void) {
+	uint32_t key[4];
+
+	if (!entropy_fill(key, 4)) {
+		return;
+	}
+	uint8_t epoch = (groupkey_epoch() + 1) % GROUPKEY_EPOCHS;
+	if (!groupkey_install(key, epoch)) {
+		return;
+	}
+	writeKeyToFlash((uint64_t*) key, epoch, &EraseInitStruct);
+	memcpy(pKeyAES, key, AESKeySize);
+	refreshAddressTags();
+}
+
+/**
+ * Master: one REKEY frame with both halves of the current team key, sealed
+ * under the previous one and sent to its broadcast tag, so members still on
+ * the old epoch can read it. False if it did not go out, for lack of airtime
+ * or a clear channel.
+ */
+static bool sendRekey(void) {
+	RekeyPacket rekey[2];
+
+	memset(rekey, 0, sizeof(rekey));
+	for (uint8_t i = 0; i < 2; i++) {
+		rekey[i].preamble = REKEY_PREAMBLE;
+		rekey[i].deviceID = DEVICE_ID;
+		rekey[i].epoch = groupkey_epoch();
+		rekey[i].half = i;
+		memcpy(rekey[i].key, (uint8_t*) pKeyAES + sizeof(rekey[i].key) * i,
+				sizeof(rekey[i].key));
+	}
+
+	FrameHeader header = { 0 };
+	header.address = previousTags[ADDRESS_BROADCAST];
+	uint8_t frame[sizeof(FrameHeader) + sizeof(rekey) + FRAME_TAG_LENGTH];
+	if (airtime_wait(AIRTIME_CONTROL, sizeof(frame)) > 0) {
+		return false;
+	}
+	uint16_t length = encryptFrame(KEYSLOT_PREVIOUS, &header, rekey,
+			sizeof(rekey), frame);
+	if (length == 0 || mac_send(frame, length) != MAC_SENT) {
+		return false;
+	}
+	airtime_charge(AIRTIME_CONTROL, length);
+	return true;
+}
+
+/**
+ * Takes the next epoch's team key from a REKEY frame. Only the epoch right
+ * after the key that sealed it counts, so a REKEY played back later can't
+ * move us backwards. The flash copy is written from the main loop.
+ */
+static void receiveRekey(const RekeyPacket *rekey, uint8_t slot) {
+	uint32_t key[4];
+	uint8_t epoch = rekey[0].epoch;
+
+	if (rekey[1].preamble != REKEY_PREAMBLE || rekey[0].half != 0
+			|| rekey[1].half != 1 || rekey[1].epoch != epoch
+			|| epoch != (groupkey_epochOf(slot) + 1) % GROUPKEY_EPOCHS
+			|| epoch == groupkey_epoch()) {
+		return;
+	}
+	memcpy(key, rekey[0].key, sizeof(rekey[0].key));
+	memcpy((uint8_t*) key + sizeof(rekey[0].key), rekey[1].key,
+			sizeof(rekey[1].key));
+	if (!groupkey_install(key, epoch)) {
+		return;
+	}
+	memcpy(pKeyAES, key, AESKeySize);
+	refreshAddressTags();
+	keyDirty = 1;
+}
+
+/**
+ * Acts on one record of an opened frame. mode is which of our addresses the
+ * frame was sent to, ADDRESS_NONE if we only relay it.
+ */
+static void receiveRecord(Packet *record, const FrameHeader *header,
+		int8_t mode) {
+	bool forUs = mode != ADDRESS_NONE;
+
+	// loss is measured on what the sender numbered and sent itself to an
+	// address we can open: not relayed copies, resends to one member or
+	// bitmaps, whose numbers are someone else's
+	if (forUs && record->deviceID == header->source
+			&& mode != ADDRESS_UNICAST
+			&& record->preamble != BULK_CHUNK_PREAMBLE
+			&& record->preamble != ACK_BITMAP_PREAMBLE) {
+		link_record(record->deviceID, record->sequenceNumber,
+				mode == ADDRESS_GROUP);
+	}
+	// a message the master held for us: confirm it even if we already had
+	// it, so the master stops sending it
+	if ((record->preamble == VIBE_PREAMBLE || record->preamble == CODE_PREAMBLE)
+			&& mode == ADDRESS_UNICAST) {
+		queueAck(record->deviceID, record->sequenceNumber);
+	}
+	if ((record->preamble == VIBE_PREAMBLE || record->preamble == CODE_PREAMBLE)
+			&& relay_receive(record, header) && forUs
+			&& record->sequenceNumber > deviceSeqs[record->deviceID]) {
+
+		uint64_t pattern = record->data;
+		if (record->preamble == VIBE_PREAMBLE
+				|| codebook_render(((CodePacket*) record)->code, &pattern)) {
+			startPlayback(pattern, FRAME_PRIORITY(header->flags),
+					record->playAt);
+		}
+		if (mode == ADDRESS_GROUP) {
+			saf_store(record, FRAME_PRIORITY(header->flags), DEVICE_GROUP);
+		}
+		if (mode != ADDRESS_UNICAST) {
+			ack_received(record->deviceID, record->sequenceNumber);
+		}
+		deviceSeqs[record->deviceID] = record->sequenceNumber;
+
+	} else if (record->preamble == BEACON_PREAMBLE && forUs
+			&& record->sequenceNumber > deviceSeqs[record->deviceID]) {
+		timesync_beaconHeard(record->sequenceNumber, radio.rxTick);
+		mac_receiveBeacon((BeaconPacket*) record);
+		deviceSeqs[record->deviceID] = record->sequenceNumber;
+
+	} else if (record->preamble == SYNC_PREAMBLE && forUs
+			&& record->sequenceNumber > deviceSeqs[record->deviceID]) {
+		timesync_receiveSync((SyncPacket*) record);
+		deviceSeqs[record->deviceID] = record->sequenceNumber;
+
+	} else if ((record->preamble == BULK_OFFER_PREAMBLE
+			|| record->preamble == BULK_STATUS_PREAMBLE) && forUs
+			&& record->sequenceNumber > deviceSeqs[record->deviceID]) {
+		deviceSeqs[record->deviceID] = record->sequenceNumber;
+		Packet reply;
+		if (bulk_receive(record, &reply)) {
+			FrameHeader replyHeader = { 0 };
+			replyHeader.address = addressTags[ADDRESS_BROADCAST];
+			txqueue_push(&reply, &replyHeader, 1);
+		}
+
+	} else if (record->preamble == ACK_PREAMBLE && forUs
+			&& record->sequenceNumber > deviceSeqs[record->deviceID]) {
+		AckPacket *ack = (AckPacket*) record;
+		link_group(ack->deviceID, ack->group);
+		saf_ack(ack->deviceID, ack->ackedDevice, ack->ackedSequence);
+		ack_collect(ack->deviceID, ack->ackedDevice, ack->ackedSequence);
+		deviceSeqs[record->deviceID] = record->sequenceNumber;
+
+	} else if (record->preamble == ACK_BITMAP_PREAMBLE && forUs) {
+		ack_receiveBitmap((AckBitmapPacket*) record);
+
+	} else if (record->preamble == BULK_CHUNK_PREAMBLE && forUs) {
+		Packet reply;
+		bulk_receive(record, &reply);
+	}
+	if (MASTER_DEVICE
+			&& (record->preamble == VIBE_PREAMBLE
+					|| record->preamble == CODE_PREAMBLE
+					|| record->preamble == BEACON_PREAMBLE
+					|| record->preamble == ACK_PREAMBLE)) {
+		mac_notePeer(record->deviceID);
+		saf_notePeer(record->deviceID);
+	}
+}
+
+/**
+ * Coalesces whatever is queued into one frame, encrypts it in a single pass
+ * and transmits it, repeating it for redundancy. Returns false if the frame
+ * was held back for lack of airtime budget, a clear channel, our TDMA slot or
+ * the AES.
+ */
+static bool sendFrame(void) {
+	Packet records[AGGREGATE_MAX];
+	FrameHeader header;
+	uint8_t frame[sizeof(FrameHeader) + sizeof(records) + FRAME_TAG_LENGTH];
+	uint8_t copies = 0;
+	uint32_t queued = 0;
+
+	// outside our TDMA slot, or too late in it for even a single record, the
+	// records stay queued until it opens; mac_send checks the whole frame
+	if (mac_slotWait(FRAME_LENGTH(1)) > 0) {
+		return false;
+	}
+	uint8_t count = txqueue_pop(records, AGGREGATE_MAX, &header, &copies,
+			&queued);
+
+	header.flags &= ~FRAME_FLAG_RELAY;
+	for (uint8_t i = 0; i < count; i++) {
+		if (records[i].ttl > 0) {
+			header.flags |= FRAME_FLAG_RELAY;
+		}
+	}
+
+	uint16_t length = encryptFrame(KEYSLOT_NETWORK, &header, records,
+			count * sizeof(Packet), frame);
+	if (length == 0) {
+		// the AES timed out: keep the records for another try, as long as
+		// they would still be worth sending
+		if (HAL_GetTick() - queued <= AIRTIME_MAX_DEFER) {
+			requeueFrame(records, count, &header, copies, queued);
+		}
+		return false;
+	}
+	airtime_class_t class = FRAME_PRIORITY(header.flags);
+	for (uint8_t i = 0; i < copies; i++) {
+		// something more urgent was queued meanwhile: let it go first and
+		// put the copies we still owe back in the queue behind it
+		if (i > 0 && txqueue_topPriority() > FRAME_PRIORITY(header.flags)) {
+			requeueFrame(records, count, &header, copies - i, queued);
+			return true;
+		}
+		// over budget: hold the rest back until it refills, or shed it if
+		// that would take too long to still matter
+		uint32_t wait = airtime_wait(class, length);
+		if (wait > 0) {
+			if (HAL_GetTick() - queued + wait <= AIRTIME_MAX_DEFER) {
+				requeueFrame(records, count, &header, copies - i, queued);
+			}
+			return false;
+		}
+		mac_result_t sent = mac_send(frame, length);
+		if (sent == MAC_NOT_YET) {
+			// the slot closed under us, the rest go in the next one
+			requeueFrame(records, count, &header, copies - i, queued);
+			return false;
+		}
+		if (sent == MAC_BUSY) {
+			// the channel never cleared: the rest try again on a later pass,
+			// under the same bound as a wait for budget
+			if (HAL_GetTick() - queued <= AIRTIME_MAX_DEFER) {
+				requeueFrame(records, count, &header, copies - i, queued);
+			}
+			return false;
+		}
+		airtime_charge(class, length);
+	}
+	return true;
+}
+
+static void requeueFrame(const Packet *records, uint8_t count,
+		const FrameHeader *header, uint8_t copies, uint32_t queued) {
+	for (uint8_t i = 0; i < count; i++) {
+		txqueue_requeue(&records[i], header, copies, queued);
+	}
+}
+
+/**
+ * Turns the finished recording into a packet for our group, called from the
+ * TIM16 interrupt. A recording matching a codebook entry is sent as its code,
+ * anything else as the raw bitmap.
+ */
+static void queueRecording(int16_t code) {
+	Packet packet = { 0 };
+	uint8_t priority = recording.priority;
+
+	if (code == CODEBOOK_NO_MATCH) {
+		packet.preamble = VIBE_PREAMBLE;
+		packet.data = recording.data;
+	} else {
+		CodePacket *coded = (CodePacket*) &packet;
+		coded->preamble = CODE_PREAMBLE;
+		coded->code = code;
+		if (codebook_priority(code) > priority) {
+			priority = codebook_priority(code);
+		}
+	}
+	packet.deviceID = DEVICE_ID;
+	packet.sequenceNumber = nextSequenceNumber();
+	packet.ttl = config.relayTTL;
+	packet.playAt = timesync_target(TIMESYNC_PLAYBACK_LEAD);
+
+	FrameHeader header = { 0 };
+	header.address = addressTags[ADDRESS_GROUP];
+	header.flags = priority << FRAME_PRIORITY_SHIFT;
+	txqueue_push(&packet, &header, link_redundancy(priority));
+	saf_store(&packet, priority, DEVICE_GROUP);
+	ack_sent(&packet, priority, DEVICE_GROUP);
+}
+
+/**
+ * Hands out our next sequence number. Records are numbered from the main
+ * loop, the radio interrupt and TIM16, and an increment cut in half by
+ * another would number two records alike, the second then dropped as a
+ * replay.
+ */
+uint32_t nextSequenceNumber(void) {
+	// called from interrupts too, so leave them as masked as we found them
+	uint32_t primask = __get_PRIMASK();
+	uint32_t sequenceNumber;
+
+	__disable_irq();
+	sequenceNumber = ++deviceSeqs[DEVICE_ID];
+	__set_PRIMASK(primask);
+
+	return sequenceNumber;
+}
+
+/**
+ * Queues an acknowledgement of another device's record
+ */
+static void queueAck(uint8_t sender, uint32_t sequenceNumber) {
+	AckPacket ack;
+	memset(&ack, 0, sizeof(ack));
+	ack.preamble = ACK_PREAMBLE;
+	ack.deviceID = DEVICE_ID;
+	ack.sequenceNumber = nextSequenceNumber();
+	ack.ackedDevice = sender;
+	ack.ackedSequence = sequenceNumber;
+	ack.group = DEVICE_GROUP;
+
+	Packet packet;
+	memcpy(&packet, &ack, sizeof(Packet));
+	FrameHeader header = { 0 };
+	header.address = addressTags[ADDRESS_BROADCAST];
+	txqueue_push(&packet, &header, 1);
+}
+
+/**
+ * Plays a received pattern at its target time unless something more urgent is
+ * playing, in which case it waits in a single slot for its turn
+ */
+static void startPlayback(uint64_t data, uint8_t priority, uint8_t playAt) {
+	uint32_t start = 0;
+	if (!timesync_due(playAt, &start)) {
+		start = HAL_GetTick();
+	}
+
+	__disable_irq();
+	if (playback.enabled && priority <= playback.priority) {
+		if (!queuedPlayback.enabled || priority >= queuedPlayback.priority) {
+			queuedPlayback.data = data;
+			queuedPlayback.priority = priority;
+			queuedPlayback.count = 0;
+			queuedPlayback.start = start;
+			queuedPlayback.waiting = 1;
+			queuedPlayback.enabled = 1;
+		}
+	} else {
+		// a preempted pattern is dropped, a cue is useless half played
+		playback.data = data;
+		playback.priority = priority;
+		playback.count = 0;
+		playback.start = start;
+		playback.waiting = 1;
+		playback.enabled = 1;
+	}
+	__enable_irq();
+}
+
+/**
+ * Master: sends the beacon unless the control budget is short. Returns how
+ * many ms it still has to wait, 0 once it is out.
+ */
+static uint32_t sendBeacon(void) {
+	// the beacon goes out with the master's clock at the end of the previous
+	// one, slaves pair it with the time they heard that beacon
+	Packet records[2];
+	BeaconPacket beacon;
+	SyncPacket sync;
+	uint8_t count = 1;
+	uint8_t frame[sizeof(FrameHeader) + sizeof(records) + FRAME_TAG_LENGTH];
+
+	// checked before building it, which uses up sequence numbers
+	uint32_t wait = airtime_wait(AIRTIME_CONTROL, sizeof(frame));
+	if (wait > 0) {
+		return wait;
+	}
+	mac_buildBeacon(&beacon);
+	beacon.sequenceNumber = nextSequenceNumber();
+	memcpy(&records[0], &beacon, sizeof(Packet));
+	if (timesync_buildSync(&sync)) {
+		sync.sequenceNumber = nextSequenceNumber();
+		memcpy(&records[1], &sync, sizeof(Packet));
+		count++;
+	}
+
+	FrameHeader header = { 0 };
+	header.address = addressTags[ADDRESS_BROADCAST];
+	uint16_t length = encryptFrame(KEYSLOT_NETWORK, &header, records,
+			count * sizeof(Packet), frame);
+	if (length == 0) {
+		return 0;
+	}
+	// the radio did not take it: a fresh one is built on the next try
+	if (mac_sendBeacon(frame, length) != MAC_SENT) {
+		return CSMA_UNIT;
+	}
+	if (radio.txDone) {
+		timesync_beaconSent(beacon.sequenceNumber, radio.txTick);
+	}
+	airtime_charge(AIRTIME_CONTROL, length);
+	return 0;
+}
+
+/**
+ * Writes the cleartext header, the payload encrypted with AES-GCM and the
+ * truncated tag, which also authenticates the header. The nonce is our device
+ * ID and a frame counter that never repeats, so the keystream is usually ready
+ * in the pool. Returns the frame length, or 0 if the AES failed.
+ */
+static uint16_t encryptFrame(uint8_t slot, FrameHeader *header,
+		const void *payload, uint16_t length, uint8_t *frame) {
+	bool sealed;
+
+	header->source = DEVICE_ID;
+	header->sequenceNumber = ++frameCounter;
+	header->flags = (header->flags & ~FRAME_EPOCH_MASK)
+			| (groupkey_epochOf(slot) << FRAME_EPOCH_SHIFT);
+	memcpy(frame, header, sizeof(FrameHeader));
+	memcpy(frame + sizeof(FrameHeader), payload, length);
+
+	// the radio interrupt opens frames with the same pool and AES
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	sealed = gcm_seal(slot, header, frame + sizeof(FrameHeader), length,
+			frame + sizeof(FrameHeader) + length);
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	if (!sealed) {
+		return 0;
+	}
+	return sizeof(FrameHeader) + length + FRAME_TAG_LENGTH;
+}
+
+/**
+ * Checks a frame's tag and decrypts its payload. Returns the payload length,
+ * or 0 if the frame was not sealed under the slot's key or was changed on the
+ * way.
+ */
+static uint16_t decryptFrame(uint8_t slot, const uint8_t *frame,
+		uint8_t length, FrameHeader *header, void *payload) {
+	uint8_t plain[GCM_MAX_PAYLOAD];
+
+	if (length <= sizeof(FrameHeader) + FRAME_TAG_LENGTH
+			|| length - sizeof(FrameHeader) - FRAME_TAG_LENGTH > sizeof(plain)) {
+		return 0;
+	}
+	uint16_t cipherLength = length - sizeof(FrameHeader) - FRAME_TAG_LENGTH;
+	memcpy(header, frame, sizeof(FrameHeader));
+	memcpy(plain, frame + sizeof(FrameHeader), cipherLength);
+
+	if (!gcm_open(slot, header, plain, cipherLength,
+			frame + sizeof(FrameHeader) + cipherLength)) {
+		return 0;
+	}
+	memcpy(payload, plain, cipherLength);
+	return cipherLength;
+}
+
+/**
+ * Keyed address tag: a block naming the destination run through AES-ECB under
+ * the tag key derived from a slot's team key, truncated to 16 bits. Outsiders
+ * can't tell who a frame is for, and members can match it without decrypting
+ * the frame.
+ */
+static uint16_t addressTag(uint8_t slot, uint8_t mode, uint8_t id) {
+	uint32_t tempin[4] = { 0 };
+	uint32_t tempout[4] = { 0 };
+	uint8_t *block = (uint8_t*) tempin;
+
+	block[0] = ADDRESS_TAG_PREAMBLE;
+	block[1] = mode;
+	block[2] = id;
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	keyslot_set(KEYSLOT_SCRATCH, groupkey_tagKey(slot));
+	if (keyslot_use(KEYSLOT_SCRATCH, CRYP_AES_ECB, NULL, NULL, 0) == HAL_OK) {
+		HAL_CRYP_Encrypt(&hcryp, tempin, 16, tempout, 1);
+	}
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	return (uint16_t) tempout[0];
+}
+
+/**
+ * Tags depend on the team key, so recompute them whenever it changes. During
+ * a grace period frames of the previous epoch carry tags of the previous key.
+ */
+static void refreshAddressTags(void) {
+	addressTags[ADDRESS_BROADCAST] = addressTag(KEYSLOT_NETWORK,
+			ADDRESS_BROADCAST, 0);
+	addressTags[ADDRESS_GROUP] = addressTag(KEYSLOT_NETWORK, ADDRESS_GROUP,
+			DEVICE_GROUP);
+	addressTags[ADDRESS_UNICAST] = addressTag(KEYSLOT_NETWORK,
+			ADDRESS_UNICAST, DEVICE_ID);
+	if (groupkey_previousValid()) {
+		previousTags[ADDRESS_BROADCAST] = addressTag(KEYSLOT_PREVIOUS,
+				ADDRESS_BROADCAST, 0);
+		previousTags[ADDRESS_GROUP] = addressTag(KEYSLOT_PREVIOUS,
+				ADDRESS_GROUP, DEVICE_GROUP);
+		previousTags[ADDRESS_UNICAST] = addressTag(KEYSLOT_PREVIOUS,
+				ADDRESS_UNICAST, DEVICE_ID);
+	}
+}
+
+/**
+ * Which of our addresses a frame sealed under the slot went to, ADDRESS_NONE
+ * if none of them
+ */
+static int8_t addressMode(const FrameHeader *header, uint8_t slot) {
+	const uint16_t *tags =
+			slot == KEYSLOT_PREVIOUS ? previousTags : addressTags;
+
+	for (int8_t mode = ADDRESS_BROADCAST; mode <= ADDRESS_UNICAST; mode++) {
+		if (header->address == tags[mode]) {
+			return mode;
+		}
+	}
+	return ADDRESS_NONE;
+}
+
+/**
+ * Reads the team key into ptr and returns its epoch, 0 on a page written
+ * before epochs existed
+ */
+static uint8_t readKeyFromFlash(uint32_t *ptr, FLASH_EraseInitTypeDef *erase) {
 
 	uint32_t addr = 0x08000000 + FLASH_PAGE_SIZE * erase->Page;
 	for (int i = 0; i < AESKeySize / sizeof(uint32_t); i++) {
 		ptr[i] = ((uint32_t*) addr)[i];
 	}
+	uint32_t epoch = ((uint32_t*) addr)[AESKeySize / sizeof(uint32_t)];
+	return epoch == 0xFFFFFFFF ? 0 : epoch % GROUPKEY_EPOCHS;
 }
 
-static void writeKeyToFlash(uint64_t *ptr, FLASH_EraseInitTypeDef *erase) {
+static void writeKeyToFlash(uint64_t *ptr, uint8_t epoch,
+		FLASH_EraseInitTypeDef *erase) {
 //801f800
 	uint32_t addr = 0x08000000 + FLASH_PAGE_SIZE * erase->Page;
 
 	uint32_t pgerr = 0;
 	HAL_FLASH_Unlock();
 	HAL_FLASHEx_Erase(erase, &pgerr);
-	uint64_t alignedtmp[2] = { 0 };
-	memcpy(alignedtmp, ptr, sizeof(alignedtmp));
-	for (int i = 0; i < 2; i++) {
+	uint64_t alignedtmp[3] = { 0 };
+	memcpy(alignedtmp, ptr, AESKeySize);
+	alignedtmp[2] = epoch;
+	for (int i = 0; i < 3; i++) {
 		uint64_t val = alignedtmp[i];
 		uint32_t location = addr + (sizeof(uint64_t)) * i;
 		HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, location, val);
@@ -862,17 +2016,21 @@ static void writeKeyToFlash(uint64_t *ptr, FLASH_EraseInitTypeDef *erase) {
 	HAL_FLASH_Lock();
 }
 
-static uint32_t readSeqFromFlash(FLASH_EraseInitTypeDef *erase) {
+static uint32_t readSeqFromFlash(FLASH_EraseInitTypeDef *erase,
+		uint32_t *frames) {
 	uint32_t addr = 0x08000000 + FLASH_PAGE_SIZE * erase->Page;
+	*frames = ((uint32_t*) addr)[1];
 	return *((uint32_t*) addr);
 }
-static void writeSeqToFlash(uint32_t seq, FLASH_EraseInitTypeDef *erase) {
+static void writeSeqToFlash(uint32_t seq, uint32_t frames,
+		FLASH_EraseInitTypeDef *erase) {
 //801f000
 	uint32_t addr = 0x08000000 + FLASH_PAGE_SIZE * erase->Page;
 	uint32_t pgerr = 0;
 	HAL_FLASH_Unlock();
 	HAL_FLASHEx_Erase(erase, &pgerr);
-	HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr, seq);
+	HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr,
+			((uint64_t) frames << 32) | seq);
 	HAL_FLASH_Lock();
 }
 
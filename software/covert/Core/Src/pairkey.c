@@ -0,0 +1,242 @@
+#include "pairkey.h"
+#include "entropy.h"
+#include "kdf.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// The keypair in use, the private key unwrapped.
+static uint32_t privateKey[8];
+static uint8_t publicKey[32];
+static uint8_t uses = 0;
+static bool valid = false;
+
+/**
+ * Private Function Definitions
+ */
+static const pairkey_record_t* pairkey_page();
+static bool pairkey_keys(uint16_t nonce, uint32_t *wrapKey,
+		uint32_t *checkKey);
+static bool pairkey_wrap(pairkey_record_t *record, const uint32_t *key);
+static bool pairkey_unwrap(const pairkey_record_t *record, uint32_t *key);
+static bool pairkey_write(const pairkey_record_t *record);
+static bool pairkey_count(uint8_t use);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Picks up the keypair stored by an earlier boot, if its record is intact and
+ * was wrapped on this chip. No key is generated here, that waits for the first
+ * pairing. Call after the AES is initialised.
+ */
+void pairkey_init() {
+	const pairkey_record_t *record = pairkey_page();
+
+	valid = record->magic == PAIRKEY_MAGIC
+			&& pairkey_unwrap(record, privateKey);
+	if (!valid) {
+		memset(privateKey, 0, sizeof(privateKey));
+		return;
+	}
+	memcpy(publicKey, record->publicKey, sizeof(publicKey));
+	uses = 0;
+	while (uses < PAIRKEY_MAX_USES && record->tally[uses] != UINT64_MAX) {
+		uses++;
+	}
+}
+
+/**
+ * Hands out the keypair for a pairing session and counts the use. A keypair
+ * that has served PAIRKEY_MAX_USES sessions, or none at all, is replaced: the
+ * caller gets a fresh private key, works out its public key in slices and
+ * hands both to pairkey_store.
+ */
+pairkey_status_t pairkey_acquire(uint32_t *key, uint8_t *publicOut) {
+	if (!valid || uses >= PAIRKEY_MAX_USES) {
+		valid = false;
+		if (!entropy_fill(key, 8)) {
+			return PAIRKEY_FAILED;
+		}
+		return PAIRKEY_FRESH;
+	}
+	// losing the count to a failed write only makes the key last longer
+	pairkey_count(uses);
+	uses++;
+
+	memcpy(key, privateKey, sizeof(privateKey));
+	memcpy(publicOut, publicKey, sizeof(publicKey));
+	return PAIRKEY_READY;
+}
+
+/**
+ * Keeps a freshly generated keypair, counting the session it was made for.
+ * The private key goes to flash wrapped; if that fails it still serves this
+ * boot.
+ */
+void pairkey_store(const uint32_t *key, const uint8_t *publicIn) {
+	pairkey_record_t record;
+	uint32_t nonce = 0;
+
+	memcpy(privateKey, key, sizeof(privateKey));
+	memcpy(publicKey, publicIn, sizeof(publicKey));
+	uses = 1;
+	valid = true;
+
+	memset(&record, 0xFF, sizeof(record));
+	record.magic = PAIRKEY_MAGIC;
+	record._reserved = 0;
+	record._reserved2 = 0;
+	// a fresh nonce per keypair, so no two ever share a keystream; without
+	// one the keypair only serves this boot
+	if (!entropy_get(&nonce)) {
+		return;
+	}
+	record.nonce = nonce;
+	memcpy(record.publicKey, publicIn, sizeof(record.publicKey));
+	if (pairkey_wrap(&record, key) && pairkey_write(&record)) {
+		pairkey_count(0);
+	}
+	memset(&record, 0, sizeof(record));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static const pairkey_record_t* pairkey_page() {
+	return (const pairkey_record_t*) (FLASH_BASE
+			+ FLASH_PAGE_SIZE * PAIRKEY_PAGE);
+}
+
+/**
+ * The keys a record is wrapped and checked with: from the chip's unique ID,
+ * so a page copied to another device opens nowhere, and the record's nonce
+ */
+static bool pairkey_keys(uint16_t nonce, uint32_t *wrapKey,
+		uint32_t *checkKey) {
+	uint32_t root[4];
+	bool derived;
+
+	// the radio interrupt opens frames on the same AES
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	derived = kdf_extract((const uint8_t*) UID_BASE, 12, root)
+			&& kdf_expand(root, KDF_LABEL_WRAP, nonce, wrapKey)
+			&& kdf_expand(root, KDF_LABEL_CHECK, nonce, checkKey);
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	memset(root, 0, sizeof(root));
+	return derived;
+}
+
+/**
+ * XORs the key with two keystream blocks into the record and tags the
+ * wrapped key together with the public key
+ */
+static bool pairkey_wrap(pairkey_record_t *record, const uint32_t *key) {
+	uint32_t wrapKey[4];
+	uint32_t checkKey[4];
+	uint32_t stream[4];
+	uint8_t mac[16];
+	bool ok = pairkey_keys(record->nonce, wrapKey, checkKey);
+
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	for (uint8_t block = 0; ok && block < 2; block++) {
+		ok = kdf_expand(wrapKey, KDF_LABEL_WRAP, block, stream);
+		for (uint8_t i = 0; ok && i < 4; i++) {
+			record->privateKey[4 * block + i] = key[4 * block + i] ^ stream[i];
+		}
+	}
+	ok = ok
+			&& kdf_cmac(checkKey, (const uint8_t*) record->privateKey,
+					sizeof(record->privateKey) + sizeof(record->publicKey),
+					mac);
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+	memcpy(&record->tag, mac, sizeof(record->tag));
+
+	memset(wrapKey, 0, sizeof(wrapKey));
+	memset(checkKey, 0, sizeof(checkKey));
+	memset(stream, 0, sizeof(stream));
+	return ok;
+}
+
+/**
+ * Checks the record's tag and recovers the private key, false if the record
+ * was not wrapped on this chip or was altered
+ */
+static bool pairkey_unwrap(const pairkey_record_t *record, uint32_t *key) {
+	uint32_t wrapKey[4];
+	uint32_t checkKey[4];
+	uint32_t stream[4];
+	uint8_t mac[16];
+	bool ok = pairkey_keys(record->nonce, wrapKey, checkKey);
+
+	HAL_NVIC_DisableIRQ(RADIO_INT_EXTI_IRQn);
+	ok = ok
+			&& kdf_cmac(checkKey, (const uint8_t*) record->privateKey,
+					sizeof(record->privateKey) + sizeof(record->publicKey),
+					mac) && memcmp(mac, &record->tag, sizeof(record->tag)) == 0;
+	for (uint8_t block = 0; ok && block < 2; block++) {
+		ok = kdf_expand(wrapKey, KDF_LABEL_WRAP, block, stream);
+		for (uint8_t i = 0; ok && i < 4; i++) {
+			key[4 * block + i] = record->privateKey[4 * block + i] ^ stream[i];
+		}
+	}
+	HAL_NVIC_EnableIRQ(RADIO_INT_EXTI_IRQn);
+
+	memset(wrapKey, 0, sizeof(wrapKey));
+	memset(checkKey, 0, sizeof(checkKey));
+	memset(stream, 0, sizeof(stream));
+	return ok;
+}
+
+/**
+ * Erases the page and programs the record up to the tally a double word at a
+ * time, back to front so the magic at the start lands last. The tally stays
+ * erased for pairkey_count.
+ */
+static bool pairkey_write(const pairkey_record_t *record) {
+	uint64_t words[offsetof(pairkey_record_t, tally) / 8];
+	memcpy(words, record, sizeof(words));
+
+	FLASH_EraseInitTypeDef erase;
+	erase.Banks = FLASH_BANK_1;
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Page = PAIRKEY_PAGE;
+	erase.NbPages = 1;
+
+	uint32_t addr = FLASH_BASE + FLASH_PAGE_SIZE * PAIRKEY_PAGE;
+	uint32_t pgerr = 0;
+	bool ok = true;
+	HAL_FLASH_Unlock();
+	if (HAL_FLASHEx_Erase(&erase, &pgerr) != HAL_OK) {
+		ok = false;
+	}
+	for (int16_t i = sizeof(words) / sizeof(words[0]) - 1; ok && i >= 0; i--) {
+		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD,
+				addr + sizeof(uint64_t) * i, words[i]) != HAL_OK) {
+			ok = false;
+		}
+	}
+	HAL_FLASH_Lock();
+	memset(words, 0, sizeof(words));
+	return ok;
+}
+
+/**
+ * Marks a session as served by programming its tally word, without an erase
+ */
+static bool pairkey_count(uint8_t use) {
+	uint32_t addr = FLASH_BASE + FLASH_PAGE_SIZE * PAIRKEY_PAGE
+			+ offsetof(pairkey_record_t, tally) + sizeof(uint64_t) * use;
+	bool ok;
+
+	HAL_FLASH_Unlock();
+	ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr, 0) == HAL_OK;
+	HAL_FLASH_Lock();
+	return ok;
+}
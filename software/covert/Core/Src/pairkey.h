@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Flash page holding our Curve25519 keypair, below the two config pages.
+#ifndef PAIRKEY_PAGE
+#define PAIRKEY_PAGE (FLASH_PAGE_NB - 5)
+#endif
+
+// Pairing sessions a keypair serves before a fresh one is drawn.
+#ifndef PAIRKEY_MAX_USES
+#define PAIRKEY_MAX_USES 8
+#endif
+
+#define PAIRKEY_MAGIC 0x25519CAB
+
+
+/**
+ * What pairkey_acquire handed out.
+ */
+typedef enum
+{
+	PAIRKEY_READY = 0,    // The stored keypair, ready to use.
+	PAIRKEY_FRESH = 1,    // A new private key, its public key still to compute.
+	PAIRKEY_FAILED = 2,   // The RNG failed, there is no key.
+} pairkey_status_t;
+
+/**
+ * Layout of the flash page holding the keypair. The private key is stored
+ * wrapped under a key derived from the chip's unique ID and a nonce, the tag
+ * authenticates it with the public key. Each session served programs one
+ * tally word, so the page is only erased when the keypair is replaced.
+ */
+typedef struct {
+	uint32_t magic;
+	uint16_t nonce;
+	uint16_t _reserved;
+	uint32_t tag;
+	uint32_t _reserved2;
+	uint32_t privateKey[8];
+	uint8_t publicKey[32];
+	uint64_t tally[PAIRKEY_MAX_USES];
+} pairkey_record_t;
+
+
+/**
+ *  Global Functions
+ */
+void pairkey_init();
+pairkey_status_t pairkey_acquire(uint32_t *privateKey, uint8_t *publicKey);
+void pairkey_store(const uint32_t *privateKey, const uint8_t *publicKey);
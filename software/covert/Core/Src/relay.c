@@ -0,0 +1,105 @@
+#include "relay.h"
+#include "entropy.h"
+
+#include <string.h>
+
+static relay_entry_t cache[RELAY_CACHE_SIZE];
+static uint8_t cacheNext = 0;
+
+/**
+ * Private Function Definitions
+ */
+static relay_entry_t* relay_find(uint8_t sender, uint32_t sequenceNumber);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Empties the dedup cache
+ */
+void relay_init() {
+	memset(cache, 0, sizeof(cache));
+	cacheNext = 0;
+}
+
+/**
+ * Records a decrypted packet in the dedup cache and returns true the first
+ * time its (sender, sequence number) is heard. A first copy with hops left is
+ * scheduled for rebroadcast after a random delay. A later copy whose ttl is no
+ * higher than the one we would send means a neighbour already relayed it, so
+ * our pending rebroadcast is suppressed. The frame header is kept so the
+ * rebroadcast goes to the same destination.
+ */
+bool relay_receive(const Packet *packet, const FrameHeader *header) {
+	relay_entry_t *entry = relay_find(packet->deviceID, packet->sequenceNumber);
+
+	if (entry) {
+		if (entry->state == RELAY_PENDING && packet->ttl <= entry->packet.ttl) {
+			entry->state = RELAY_SEEN;
+		}
+		return false;
+	}
+
+	entry = &cache[cacheNext];
+	cacheNext = (cacheNext + 1) % RELAY_CACHE_SIZE;
+
+	entry->state = RELAY_SEEN;
+	entry->sender = packet->deviceID;
+	entry->sequenceNumber = packet->sequenceNumber;
+
+	if (RELAY_MODE && packet->ttl > 0 && packet->deviceID != DEVICE_ID) {
+		uint32_t jitter;
+		entropy_get(&jitter);
+
+		memcpy(&entry->packet, packet, sizeof(Packet));
+		memcpy(&entry->header, header, sizeof(FrameHeader));
+		entry->packet.ttl--;
+		// higher classes wait proportionally less before going back out
+		entry->due = HAL_GetTick()
+				+ ((RELAY_DELAY_MIN + (jitter % RELAY_DELAY_SPREAD))
+						>> FRAME_PRIORITY(header->flags));
+		entry->state = RELAY_PENDING;
+	}
+	return true;
+}
+
+/**
+ * Copies out a packet whose rebroadcast delay has expired, if any
+ */
+bool relay_poll(Packet *packet, FrameHeader *header) {
+	bool found = false;
+
+	__disable_irq();
+	for (uint8_t i = 0; i < RELAY_CACHE_SIZE; i++) {
+		if (cache[i].state == RELAY_PENDING
+				&& (int32_t) (HAL_GetTick() - cache[i].due) >= 0) {
+			memcpy(packet, &cache[i].packet, sizeof(Packet));
+			memcpy(header, &cache[i].header, sizeof(FrameHeader));
+			cache[i].state = RELAY_SEEN;
+			found = true;
+			break;
+		}
+	}
+	__enable_irq();
+
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static relay_entry_t* relay_find(uint8_t sender, uint32_t sequenceNumber) {
+	for (uint8_t i = 0; i < RELAY_CACHE_SIZE; i++) {
+		if (cache[i].sender == sender
+				&& cache[i].sequenceNumber == sequenceNumber) {
+			return &cache[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+#ifndef RELAY_CACHE_SIZE
+#define RELAY_CACHE_SIZE 16
+#endif
+
+#ifndef RELAY_DELAY_MIN
+#define RELAY_DELAY_MIN 100
+#endif
+
+#ifndef RELAY_DELAY_SPREAD
+#define RELAY_DELAY_SPREAD 400
+#endif
+
+
+/**
+ * State of a (sender, sequence number) pair in the dedup cache.
+ */
+typedef enum
+{
+	RELAY_SEEN = 0,      // Heard, nothing left to do.
+	RELAY_PENDING = 1,   // Waiting for its rebroadcast delay to expire.
+} relay_state_t;
+
+typedef struct {
+	uint8_t sender;
+	uint32_t sequenceNumber;
+	volatile uint8_t state;
+	uint32_t due;
+	Packet packet;
+	FrameHeader header;
+} relay_entry_t;
+
+
+/**
+ *  Global Functions
+ */
+void relay_init();
+bool relay_receive(const Packet *packet, const FrameHeader *header);
+bool relay_poll(Packet *packet, FrameHeader *header);
@@ -4,12 +4,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Staging for FIFO bursts: the register address followed by the payload.
+static uint8_t burstTx[RFM95_MAX_PAYLOAD + 1];
+static uint8_t burstRx[RFM95_MAX_PAYLOAD + 1];
+static uint8_t received[RFM95_MAX_PAYLOAD];
+// Set from the SPI DMA callbacks: 1 when done, 2 on error
+static volatile uint8_t spiDone = 0;
+
 /**
  * Private Function Definitions
  */
 //static void rfm95_reset();
 //static bool rfm95_read(rfm95_register_t reg, uint8_t *buffer);
 //static bool rfm95_write(rfm95_register_t reg, uint8_t value);
+static bool rfm95_waitSpi();
+static bool rfm95_startTx(uint8_t *payload, size_t payloadLength);
+static bool rfm95_cad();
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -133,32 +143,20 @@ bool transmitPackage(uint8_t *payload, size_t payloadLength) {
 	}
 	handle->txDone = false;
 
-	uint8_t regopmode = 0;
-	do {
-		rfm95_read(RFM95_REGISTER_OP_MODE, &regopmode);
-		if (!rfm95_write(RFM95_REGISTER_OP_MODE,
-		RFM95_REGISTER_OP_MODE_LORA_STANDBY))
-			return false;
-		HAL_Delay(1);
-	} while (regopmode != RFM95_REGISTER_OP_MODE_LORA_STANDBY);
-
-	if (!rfm95_write(RFM95_REGISTER_PAYLOAD_LENGTH, payloadLength))
-		return false;
-
-	// Set SPI pointer to start of TX section in FIFO
-	if (!rfm95_write(RFM95_REGISTER_FIFO_ADDR_PTR, 0x80))
-		return false;
-
-	// Write payload to FIFO.
-	for (size_t i = 0; i < payloadLength; i++) {
-		rfm95_write(RFM95_REGISTER_FIFO_ACCESS, payload[i]);
+	// the RX done interrupt reads the FIFO over the same SPI and buffers
+	HAL_NVIC_DisableIRQ(handle->irq_line);
+	bool started = rfm95_startTx(payload, payloadLength);
+	if (!started) {
+		// nothing went out, so no TX done will come to clear the way for
+		// the next attempt
+		rfm95_write(RFM95_REGISTER_OP_MODE,
+		RFM95_REGISTER_OP_MODE_LORA_RXCONTINUOUS | 0x80);
+		handle->txDone = true;
 	}
-
-	if (!rfm95_write(RFM95_REGISTER_DIO_MAPPING_1,
-	RFM95_REGISTER_DIO_MAPPING_1_IRQ_TXDONE))
-		return false;
-	if (!rfm95_write(RFM95_REGISTER_OP_MODE, RFM95_REGISTER_OP_MODE_LORA_TX))
+	HAL_NVIC_EnableIRQ(handle->irq_line);
+	if (!started) {
 		return false;
+	}
 
 	// todo check this
 
@@ -177,6 +175,19 @@ bool transmitPackage(uint8_t *payload, size_t payloadLength) {
 
 }
 
+/**
+ * Senses the channel before a transmission. A frame already being demodulated
+ * counts as busy straight away; otherwise a CAD cycle looks for a LoRa
+ * preamble, which also catches signals below the noise floor.
+ */
+bool rfm95_channelActivity() {
+	// an RX done in the middle would take the SPI from under us
+	HAL_NVIC_DisableIRQ(handle->irq_line);
+	bool busy = rfm95_cad();
+	HAL_NVIC_EnableIRQ(handle->irq_line);
+	return busy;
+}
+
 /**
  * Reads payload stored in receivedPacketData global variable and stores it in buffer.
  * also stores receivedPacketLength in packetLength
@@ -201,6 +212,8 @@ bool transmitPackage(uint8_t *payload, size_t payloadLength) {
  * Generic function for handling interrupt, for tx and rx
  */
 void rfm95_handleInterrupt() {
+	// stamp the end of the frame before the SPI traffic below delays us
+	uint32_t tick = HAL_GetTick();
 	uint8_t irqFlags;
 	rfm95_read(RFM95_REGISTER_IRQ_FLAGS, &irqFlags);
 	rfm95_write(RFM95_REGISTER_IRQ_FLAGS, irqFlags);
@@ -209,6 +222,18 @@ void rfm95_handleInterrupt() {
 //		++packetError;
 		if ((irqFlags & 0x40) != 0) {
 //			--packetError;
+			handle->rxTick = tick;
+
+			// link quality of this packet, RSSI corrected below the noise floor
+			uint8_t snr = 0;
+			uint8_t rssi = 0;
+			rfm95_read(RFM95_REGISTER_PKT_SNR_VALUE, &snr);
+			rfm95_read(RFM95_REGISTER_PKT_RSSI_VALUE, &rssi);
+			handle->snr = (int8_t) snr;
+			handle->rssi = (int16_t) rssi - RFM95_RSSI_OFFSET_HF;
+			if (handle->snr < 0) {
+				handle->rssi += handle->snr / 4;
+			}
 			// read packet length
 			uint8_t packetLength;
 
@@ -222,10 +247,11 @@ void rfm95_handleInterrupt() {
 			rfm95_read(0x10, &currentAddr);
 			rfm95_write(RFM95_REGISTER_FIFO_ADDR_PTR, currentAddr);
 
-			uint8_t *buffer = (uint8_t*) calloc(packetLength, sizeof(uint8_t));
+			uint8_t *buffer = received;
 
-			for (size_t i = 0; i < packetLength; i++) {
-				rfm95_read(RFM95_REGISTER_FIFO_ACCESS, &buffer[i]);
+			if (!rfm95_burstRead(RFM95_REGISTER_FIFO_ACCESS, buffer,
+					packetLength)) {
+				packetLength = 0;
 			}
 
 //            if (!handle -> rxDoneCallback && isPacketValid(buffer, packetLength)) {
@@ -241,7 +267,7 @@ void rfm95_handleInterrupt() {
 //            	memcpy(receivedPacketData, buffer + 4, packetLength);
 //            }
 
-			if (handle->rxDoneCallback) {
+			if (handle->rxDoneCallback && packetLength > 0) {
 				handle->rxDoneCallback(buffer, packetLength);
 			}
 			// maybe clear the fifo by doing this?
@@ -258,10 +284,10 @@ void rfm95_handleInterrupt() {
 
 			rfm95_write(RFM95_REGISTER_FIFO_RX_BASE_ADDR, 0x00);
 			//RegSeqConfig1?
-			free(buffer);
 
 		}
 		if ((irqFlags & 0x08) != 0) {
+			handle->txTick = tick;
 			handle->txDone = true;
 			rfm95_write(RFM95_REGISTER_OP_MODE,
 					RFM95_REGISTER_OP_MODE_LORA_RXCONTINUOUS | 0x80);
@@ -314,6 +340,63 @@ bool rfm95_write(rfm95_register_t reg, uint8_t value) {
 	return true;
 }
 
+/**
+ * Writes a run of bytes starting at reg in a single transaction, moved by DMA
+ * while the CPU sleeps. Used to fill the FIFO.
+ */
+bool rfm95_burstWrite(rfm95_register_t reg, const uint8_t *data, size_t length) {
+	if (length > RFM95_MAX_PAYLOAD)
+		return false;
+
+	burstTx[0] = (uint8_t) reg | 0x80u;
+	memcpy(burstTx + 1, data, length);
+
+	spiDone = 0;
+	HAL_GPIO_WritePin(handle->nss_port, handle->nss_pin, GPIO_PIN_RESET);
+	bool ok = HAL_SPI_Transmit_DMA(handle->spi_handle, burstTx, length + 1)
+			== HAL_OK && rfm95_waitSpi();
+	HAL_GPIO_WritePin(handle->nss_port, handle->nss_pin, GPIO_PIN_SET);
+
+	return ok;
+}
+
+/**
+ * Reads a run of bytes starting at reg in a single transaction, moved by DMA
+ * while the CPU sleeps. Used to empty the FIFO.
+ */
+bool rfm95_burstRead(rfm95_register_t reg, uint8_t *data, size_t length) {
+	if (length > RFM95_MAX_PAYLOAD)
+		return false;
+
+	memset(burstTx, 0, length + 1);
+	burstTx[0] = (uint8_t) reg & 0x7fu;
+
+	spiDone = 0;
+	HAL_GPIO_WritePin(handle->nss_port, handle->nss_pin, GPIO_PIN_RESET);
+	bool ok = HAL_SPI_TransmitReceive_DMA(handle->spi_handle, burstTx, burstRx,
+			length + 1) == HAL_OK && rfm95_waitSpi();
+	HAL_GPIO_WritePin(handle->nss_port, handle->nss_pin, GPIO_PIN_SET);
+
+	if (ok)
+		memcpy(data, burstRx + 1, length);
+	return ok;
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+	if (hspi == handle->spi_handle)
+		spiDone = 1;
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+	if (hspi == handle->spi_handle)
+		spiDone = 1;
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+	if (hspi == handle->spi_handle)
+		spiDone = 2;
+}
+
 /**
  * Resets Device for initialization
  */
@@ -324,3 +407,89 @@ void rfm95_reset() {
 	HAL_Delay(5);
 }
 
+/**
+ * Sleeps until the DMA callbacks report the burst done. The DMA interrupts
+ * sit above the radio's, so this also works from rfm95_handleInterrupt.
+ */
+static bool rfm95_waitSpi() {
+	uint32_t start = HAL_GetTick();
+
+	__disable_irq();
+	while (!spiDone && HAL_GetTick() - start < RFM95_SPI_TIMEOUT) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+
+	if (!spiDone)
+		HAL_SPI_Abort(handle->spi_handle);
+	return spiDone == 1;
+}
+
+/**
+ * Puts the radio in standby, loads the FIFO and starts the transmission
+ */
+static bool rfm95_startTx(uint8_t *payload, size_t payloadLength) {
+	uint8_t regopmode = 0;
+	uint8_t tries = 0;
+	do {
+		if (tries++ == RFM95_STANDBY_TRIES)
+			return false;
+		rfm95_read(RFM95_REGISTER_OP_MODE, &regopmode);
+		if (!rfm95_write(RFM95_REGISTER_OP_MODE,
+		RFM95_REGISTER_OP_MODE_LORA_STANDBY))
+			return false;
+		HAL_Delay(1);
+	} while (regopmode != RFM95_REGISTER_OP_MODE_LORA_STANDBY);
+
+	if (!rfm95_write(RFM95_REGISTER_PAYLOAD_LENGTH, payloadLength))
+		return false;
+
+	// Set SPI pointer to start of TX section in FIFO
+	if (!rfm95_write(RFM95_REGISTER_FIFO_ADDR_PTR, 0x80))
+		return false;
+
+	// Write payload to FIFO.
+	if (!rfm95_burstWrite(RFM95_REGISTER_FIFO_ACCESS, payload, payloadLength))
+		return false;
+
+	if (!rfm95_write(RFM95_REGISTER_DIO_MAPPING_1,
+	RFM95_REGISTER_DIO_MAPPING_1_IRQ_TXDONE))
+		return false;
+	return rfm95_write(RFM95_REGISTER_OP_MODE, RFM95_REGISTER_OP_MODE_LORA_TX);
+}
+
+/**
+ * Looks at the modem status and runs one CAD cycle, true if the channel is
+ * taken
+ */
+static bool rfm95_cad() {
+	uint8_t modemStat = 0;
+	if (!rfm95_read(RFM95_REGISTER_MODEM_STAT, &modemStat))
+		return true;
+	if (modemStat & RFM95_REGISTER_MODEM_STAT_BUSY)
+		return true;
+
+	if (!rfm95_write(RFM95_REGISTER_OP_MODE,
+	RFM95_REGISTER_OP_MODE_LORA_STANDBY))
+		return true;
+	rfm95_write(RFM95_REGISTER_IRQ_FLAGS,
+	RFM95_REGISTER_IRQ_FLAGS_CAD_DONE | RFM95_REGISTER_IRQ_FLAGS_CAD_DETECTED);
+	rfm95_write(RFM95_REGISTER_OP_MODE,
+	RFM95_REGISTER_OP_MODE_LORA_CAD | 0x80);
+
+	uint8_t irqFlags = 0;
+	uint32_t start = HAL_GetTick();
+	do {
+		rfm95_read(RFM95_REGISTER_IRQ_FLAGS, &irqFlags);
+	} while ((irqFlags & RFM95_REGISTER_IRQ_FLAGS_CAD_DONE) == 0
+			&& HAL_GetTick() - start < RFM95_CAD_TIMEOUT);
+
+	rfm95_write(RFM95_REGISTER_IRQ_FLAGS,
+	RFM95_REGISTER_IRQ_FLAGS_CAD_DONE | RFM95_REGISTER_IRQ_FLAGS_CAD_DETECTED);
+	rfm95_write(RFM95_REGISTER_OP_MODE,
+	RFM95_REGISTER_OP_MODE_LORA_RXCONTINUOUS | 0x80);
+
+	return (irqFlags & RFM95_REGISTER_IRQ_FLAGS_CAD_DETECTED) != 0;
+}
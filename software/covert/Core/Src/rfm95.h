@@ -15,6 +15,18 @@
 #define RFM95_SEND_TIMEOUT 1000
 #endif
 
+// Polls of the op mode register before a switch to standby is given up.
+#ifndef RFM95_STANDBY_TRIES
+#define RFM95_STANDBY_TRIES 10
+#endif
+
+#ifndef RFM95_CAD_TIMEOUT
+#define RFM95_CAD_TIMEOUT 20
+#endif
+
+// Largest payload the FIFO holds, moved in one DMA burst.
+#define RFM95_MAX_PAYLOAD 255
+
 
 /**
  * Constants for RFM95 register values
@@ -24,6 +36,7 @@
 #define RFM95_REGISTER_OP_MODE_SLEEP                            0x00
 #define RFM95_REGISTER_OP_MODE_LORA_RXCONTINUOUS                0x05
 #define RFM95_REGISTER_OP_MODE_LORA_RXSINGLE                    0x06
+#define RFM95_REGISTER_OP_MODE_LORA_CAD                         0x07
 #define RFM95_REGISTER_OP_MODE_LORA                             0x80
 #define RFM95_REGISTER_OP_MODE_LORA_STANDBY                     0x81
 #define RFM95_REGISTER_OP_MODE_LORA_TX                          0x83
@@ -36,6 +49,13 @@
 #define RFM95_REGISTER_DIO_MAPPING_1_IRQ_TXDONE                 0x40
 #define RFM95_REGISTER_DIO_MAPPING_1_IRQ_RXDONE                 0x00
 
+#define RFM95_REGISTER_IRQ_FLAGS_CAD_DETECTED                   0x01
+#define RFM95_REGISTER_IRQ_FLAGS_CAD_DONE                       0x04
+
+#define RFM95_REGISTER_MODEM_STAT_BUSY                          0x0B
+
+#define RFM95_RSSI_OFFSET_HF                                    157
+
 #define RFM95_REGISTER_INVERT_IQ_1_ON_TXONLY                    0x27
 #define RFM95_REGISTER_INVERT_IQ_1_OFF                          0x26
 #define RFM95_REGISTER_INVERT_IQ_2_ON                           0x19
@@ -57,6 +77,9 @@ typedef enum
 	RFM95_REGISTER_FIFO_TX_BASE_ADDR = 0x0E,
 	RFM95_REGISTER_FIFO_RX_BASE_ADDR = 0x0F,
 	RFM95_REGISTER_IRQ_FLAGS = 0x12,
+	RFM95_REGISTER_MODEM_STAT = 0x18,
+	RFM95_REGISTER_PKT_SNR_VALUE = 0x19,
+	RFM95_REGISTER_PKT_RSSI_VALUE = 0x1A,
 	RFM95_REGISTER_MODEM_CONFIG_1 = 0x1D,
 	RFM95_REGISTER_MODEM_CONFIG_2 = 0x1E,
 	RFM95_REGISTER_SYMB_TIMEOUT_LSB = 0x1F,
@@ -107,11 +130,16 @@ typedef struct {
 
 	GPIO_TypeDef *irq_port;   //The port of the IRQ / DIO0 pin.
 	uint16_t irq_pin;         //The IRQ / DIO0 pin.
+	IRQn_Type irq_line;       //The EXTI line the IRQ pin interrupts on.
 
 	GPIO_TypeDef *dio5_port;  // The port of the IRQ / DIO0 pin.
 	uint16_t dio5_pin;        //The IRQ / DIO0 pin.
 
 	volatile uint8_t txDone;
+	volatile uint32_t txTick; // HAL tick of the last TX done interrupt.
+	volatile uint32_t rxTick; // HAL tick of the last RX done interrupt.
+	volatile int8_t snr;      // SNR of the last packet, in 0.25 dB.
+	volatile int16_t rssi;    // RSSI of the last packet, in dBm.
 	volatile FP rxDoneCallback;
 
 } rfm95_handle_t;
@@ -130,11 +158,14 @@ rfm95_handle_t *handle;
 bool rfm95_init(rfm95_handle_t *handle_pointer);
 bool rfm95_setPower(int8_t power);
 void rfm95_handleInterrupt();
+bool rfm95_channelActivity();
 
 bool transmitPackage(uint8_t *payload, size_t payloadLength);
 bool receivePackage(uint8_t **buffer, uint8_t *packetLength);
 bool rfm95_write(rfm95_register_t reg, uint8_t value);
 bool rfm95_read(rfm95_register_t reg, uint8_t *buffer);
+bool rfm95_burstWrite(rfm95_register_t reg, const uint8_t *data, size_t length);
+bool rfm95_burstRead(rfm95_register_t reg, uint8_t *data, size_t length);
 void rfm95_reset();
 
 
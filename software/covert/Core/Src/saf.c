@@ -0,0 +1,163 @@
+#include "saf.h"
+#include "mac.h"
+#include "link.h"
+#include "timesync.h"
+
+#include <string.h>
+
+static saf_peer_t peers[SAF_PEERS];
+static uint8_t peerCount = 0;
+
+/**
+ * Private Function Definitions
+ */
+static bool saf_present(uint8_t deviceID, uint32_t since);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+void saf_init() {
+	memset(peers, 0, sizeof(peers));
+	peerCount = 0;
+}
+
+/**
+ * Master side: adds a device we heard to the members we hold messages for
+ */
+void saf_notePeer(uint8_t deviceID) {
+	if (!MASTER_DEVICE || deviceID == DEVICE_ID) {
+		return;
+	}
+	for (uint8_t i = 0; i < peerCount; i++) {
+		if (peers[i].deviceID == deviceID) {
+			return;
+		}
+	}
+	if (peerCount < SAF_PEERS) {
+		memset(&peers[peerCount], 0, sizeof(saf_peer_t));
+		peers[peerCount].deviceID = deviceID;
+		peerCount++;
+	}
+}
+
+/**
+ * Master side: keeps a copy of a message sent to group for every member of
+ * it that has gone quiet and so probably missed it. The copy goes out
+ * unicast, which any member can open, so members whose group we don't know
+ * yet get none. It has no playback target, the original one will long have
+ * passed.
+ */
+void saf_store(const Packet *record, uint8_t priority, uint8_t group) {
+	if (!MASTER_DEVICE) {
+		return;
+	}
+	uint32_t now = HAL_GetTick();
+
+	for (uint8_t i = 0; i < peerCount; i++) {
+		if (peers[i].deviceID == record->deviceID
+				|| !link_inGroup(peers[i].deviceID, group)
+				|| saf_present(peers[i].deviceID, now - SAF_STALE)) {
+			continue;
+		}
+		saf_entry_t *slot = &peers[i].entries[0];
+		for (uint8_t j = 0; j < SAF_DEPTH; j++) {
+			saf_entry_t *entry = &peers[i].entries[j];
+			if (!entry->used) {
+				slot = entry;
+				break;
+			}
+			if ((int32_t) (entry->stored - slot->stored) < 0) {
+				slot = entry;
+			}
+		}
+		memcpy(&slot->packet, record, sizeof(Packet));
+		slot->packet.ttl = 0;
+		slot->packet.playAt = TIMESYNC_NO_TARGET;
+		slot->priority = priority;
+		slot->stored = now;
+		slot->due = now;
+		slot->tries = 0;
+		slot->used = true;
+	}
+}
+
+/**
+ * Master side: a member confirmed it has the sender's record, stop holding it
+ */
+void saf_ack(uint8_t deviceID, uint8_t sender, uint32_t sequenceNumber) {
+	for (uint8_t i = 0; i < peerCount; i++) {
+		if (peers[i].deviceID != deviceID) {
+			continue;
+		}
+		for (uint8_t j = 0; j < SAF_DEPTH; j++) {
+			saf_entry_t *entry = &peers[i].entries[j];
+			if (entry->used && entry->packet.deviceID == sender
+					&& entry->packet.sequenceNumber == sequenceNumber) {
+				entry->used = false;
+			}
+		}
+	}
+}
+
+/**
+ * Master side: copies out a held message whose member has been heard since it
+ * was stored and whose retry time has come. Gives up on messages that expired
+ * or went unacknowledged too often.
+ */
+bool saf_poll(Packet *record, uint8_t *deviceID, uint8_t *priority) {
+	if (!MASTER_DEVICE) {
+		return false;
+	}
+	uint32_t now = HAL_GetTick();
+	bool found = false;
+
+	__disable_irq();
+
+	for (uint8_t i = 0; i < peerCount; i++) {
+		for (uint8_t j = 0; j < SAF_DEPTH; j++) {
+			saf_entry_t *entry = &peers[i].entries[j];
+			if (!entry->used) {
+				continue;
+			}
+			if (now - entry->stored > SAF_EXPIRY
+					|| entry->tries >= SAF_MAX_TRIES) {
+				entry->used = false;
+				continue;
+			}
+			if ((int32_t) (now - entry->due) < 0
+					|| !saf_present(peers[i].deviceID, entry->stored)) {
+				continue;
+			}
+			memcpy(record, &entry->packet, sizeof(Packet));
+			*deviceID = peers[i].deviceID;
+			*priority = entry->priority;
+			entry->due = now + SAF_RETRY;
+			entry->tries++;
+			found = true;
+			break;
+		}
+		if (found) {
+			break;
+		}
+	}
+	__enable_irq();
+
+	return found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * True if the member was heard after the given tick
+ */
+static bool saf_present(uint8_t deviceID, uint32_t since) {
+	const link_peer_t *peer = link_peer(deviceID);
+	return peer && (int32_t) (peer->lastSeen - since) > 0;
+}
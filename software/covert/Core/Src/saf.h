@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// Team members the master holds messages for.
+#ifndef SAF_PEERS
+#define SAF_PEERS 8
+#endif
+
+// Messages held per member, the oldest is dropped when full.
+#ifndef SAF_DEPTH
+#define SAF_DEPTH 4
+#endif
+
+// A member not heard from for this long is presumed to miss what is sent,
+// in ms. Three presence intervals.
+#ifndef SAF_STALE
+#define SAF_STALE (3 * MAC_PRESENCE_INTERVAL)
+#endif
+
+// Wait for an ACK before delivering again, in ms.
+#ifndef SAF_RETRY
+#define SAF_RETRY 3000
+#endif
+
+#ifndef SAF_MAX_TRIES
+#define SAF_MAX_TRIES 5
+#endif
+
+// A cue this old is no use any more, in ms.
+#ifndef SAF_EXPIRY
+#define SAF_EXPIRY 300000
+#endif
+
+
+/**
+ * A message held for one member.
+ */
+typedef struct {
+	Packet packet;
+	uint8_t priority;
+	uint32_t stored;
+	uint32_t due;
+	uint8_t tries;
+	bool used;
+} saf_entry_t;
+
+typedef struct {
+	uint8_t deviceID;
+	saf_entry_t entries[SAF_DEPTH];
+} saf_peer_t;
+
+
+/**
+ *  Global Functions
+ */
+void saf_init();
+void saf_notePeer(uint8_t deviceID);
+void saf_store(const Packet *record, uint8_t priority, uint8_t group);
+void saf_ack(uint8_t deviceID, uint8_t sender, uint32_t sequenceNumber);
+bool saf_poll(Packet *record, uint8_t *deviceID, uint8_t *priority);
@@ -24,6 +24,14 @@
 /* USER CODE BEGIN Includes */
 
 /* USER CODE END Includes */
+extern DMA_HandleTypeDef hdma_aes_in;
+
+extern DMA_HandleTypeDef hdma_aes_out;
+
+extern DMA_HandleTypeDef hdma_spi1_rx;
+
+extern DMA_HandleTypeDef hdma_spi1_tx;
+
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN TD */
@@ -98,6 +106,42 @@ void HAL_CRYP_MspInit(CRYP_HandleTypeDef* hcryp)
   /* USER CODE END AES_MspInit 0 */
     /* Peripheral clock enable */
     __HAL_RCC_AES_CLK_ENABLE();
+
+    /* AES DMA Init */
+    /* AES_IN Init */
+    hdma_aes_in.Instance = DMA1_Channel3;
+    hdma_aes_in.Init.Request = DMA_REQUEST_AES_IN;
+    hdma_aes_in.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_aes_in.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_aes_in.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_aes_in.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma_aes_in.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_aes_in.Init.Mode = DMA_NORMAL;
+    hdma_aes_in.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_aes_in) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(hcryp,hdmain,hdma_aes_in);
+
+    /* AES_OUT Init */
+    hdma_aes_out.Instance = DMA1_Channel4;
+    hdma_aes_out.Init.Request = DMA_REQUEST_AES_OUT;
+    hdma_aes_out.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_aes_out.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_aes_out.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_aes_out.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma_aes_out.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_aes_out.Init.Mode = DMA_NORMAL;
+    hdma_aes_out.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_aes_out) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(hcryp,hdmaout,hdma_aes_out);
+
   /* USER CODE BEGIN AES_MspInit 1 */
 
   /* USER CODE END AES_MspInit 1 */
@@ -120,6 +164,10 @@ void HAL_CRYP_MspDeInit(CRYP_HandleTypeDef* hcryp)
   /* USER CODE END AES_MspDeInit 0 */
     /* Peripheral clock disable */
     __HAL_RCC_AES_CLK_DISABLE();
+
+    /* AES DMA DeInit */
+    HAL_DMA_DeInit(hcryp->hdmain);
+    HAL_DMA_DeInit(hcryp->hdmaout);
   /* USER CODE BEGIN AES_MspDeInit 1 */
 
   /* USER CODE END AES_MspDeInit 1 */
@@ -186,6 +234,9 @@ void HAL_RNG_MspInit(RNG_HandleTypeDef* hrng)
   /* USER CODE END RNG_MspInit 0 */
     /* Peripheral clock enable */
     __HAL_RCC_RNG_CLK_ENABLE();
+    /* RNG interrupt Init */
+    HAL_NVIC_SetPriority(AES_RNG_IRQn, 3, 0);
+    HAL_NVIC_EnableIRQ(AES_RNG_IRQn);
   /* USER CODE BEGIN RNG_MspInit 1 */
 
   /* USER CODE END RNG_MspInit 1 */
@@ -208,6 +259,16 @@ void HAL_RNG_MspDeInit(RNG_HandleTypeDef* hrng)
   /* USER CODE END RNG_MspDeInit 0 */
     /* Peripheral clock disable */
     __HAL_RCC_RNG_CLK_DISABLE();
+
+    /* RNG interrupt DeInit */
+  /* USER CODE BEGIN RNG:AES_RNG_IRQn disable */
+    /**
+    * Uncomment the line below to disable the "AES_RNG_IRQn" interrupt
+    * Be aware, disabling shared interrupt may affect other IPs
+    */
+    /* HAL_NVIC_DisableIRQ(AES_RNG_IRQn); */
+  /* USER CODE END RNG:AES_RNG_IRQn disable */
+
   /* USER CODE BEGIN RNG_MspDeInit 1 */
 
   /* USER CODE END RNG_MspDeInit 1 */
@@ -245,6 +306,41 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* hspi)
     GPIO_InitStruct.Alternate = GPIO_AF0_SPI1;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+    /* SPI1 DMA Init */
+    /* SPI1_RX Init */
+    hdma_spi1_rx.Instance = DMA1_Channel1;
+    hdma_spi1_rx.Init.Request = DMA_REQUEST_SPI1_RX;
+    hdma_spi1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_rx.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+    if (HAL_DMA_Init(&hdma_spi1_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(hspi,hdmarx,hdma_spi1_rx);
+
+    /* SPI1_TX Init */
+    hdma_spi1_tx.Instance = DMA1_Channel2;
+    hdma_spi1_tx.Init.Request = DMA_REQUEST_SPI1_TX;
+    hdma_spi1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_tx.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+    if (HAL_DMA_Init(&hdma_spi1_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(hspi,hdmatx,hdma_spi1_tx);
+
   /* USER CODE BEGIN SPI1_MspInit 1 */
 
   /* USER CODE END SPI1_MspInit 1 */
@@ -275,6 +371,9 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* hspi)
     */
     HAL_GPIO_DeInit(GPIOA, GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_6);
 
+    /* SPI1 DMA DeInit */
+    HAL_DMA_DeInit(hspi->hdmarx);
+    HAL_DMA_DeInit(hspi->hdmatx);
   /* USER CODE BEGIN SPI1_MspDeInit 1 */
 
   /* USER CODE END SPI1_MspDeInit 1 */
@@ -0,0 +1,193 @@
+#include "timesync.h"
+
+#include <string.h>
+
+// Master: end of the last beacon we sent, reported in the next one.
+static timesync_stamp_t lastSent;
+static bool sentValid = false;
+
+// Slave: local end of the last two beacons we heard, waiting for the master's
+// time of the same instant to arrive with the following beacon.
+static timesync_stamp_t heard[2];
+static uint8_t heardNext = 0;
+
+// Slave: latest (local, master) sample and the skew between the two clocks.
+static volatile uint32_t anchorLocal = 0;
+static volatile uint32_t anchorMaster = 0;
+static volatile int32_t skew = 0;
+static volatile bool anchorValid = false;
+
+/**
+ * Private Function Definitions
+ */
+static int32_t timesync_correction(int32_t elapsed);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Forgets every sample, we run on our own clock until the next sync
+ */
+void timesync_init() {
+	memset(heard, 0, sizeof(heard));
+	heardNext = 0;
+	sentValid = false;
+	anchorValid = false;
+	skew = 0;
+}
+
+/**
+ * Master side: remembers when a beacon finished leaving the antenna. Slaves
+ * stamp the same instant when their RX done fires, so the pair is free of the
+ * encryption, SPI and airtime delays in between.
+ */
+void timesync_beaconSent(uint32_t sequenceNumber, uint32_t txTick) {
+	lastSent.sequenceNumber = sequenceNumber;
+	lastSent.tick = txTick;
+	sentValid = true;
+}
+
+/**
+ * Master side: fills in a sync record for the previous beacon. Returns false
+ * before the first beacon has gone out.
+ */
+bool timesync_buildSync(SyncPacket *sync) {
+	if (!sentValid) {
+		return false;
+	}
+	memset(sync, 0, sizeof(SyncPacket));
+	sync->preamble = SYNC_PREAMBLE;
+	sync->deviceID = DEVICE_ID;
+	sync->beaconSequence = lastSent.sequenceNumber;
+	sync->beaconTime = lastSent.tick;
+	return true;
+}
+
+/**
+ * Slave side: notes the local time a beacon ended, called on RX done
+ */
+void timesync_beaconHeard(uint32_t sequenceNumber, uint32_t rxTick) {
+	if (MASTER_DEVICE) {
+		return;
+	}
+	heard[heardNext].sequenceNumber = sequenceNumber;
+	heard[heardNext].tick = rxTick;
+	heardNext = (heardNext + 1) % 2;
+}
+
+/**
+ * Slave side: matches the master's time for an earlier beacon with the local
+ * time we heard it, moving the offset to the new sample and folding the rate
+ * difference since the previous one into the skew estimate
+ */
+void timesync_receiveSync(const SyncPacket *sync) {
+	if (MASTER_DEVICE) {
+		return;
+	}
+	for (uint8_t i = 0; i < 2; i++) {
+		if (heard[i].sequenceNumber != sync->beaconSequence
+				|| heard[i].tick == 0) {
+			continue;
+		}
+		uint32_t local = heard[i].tick;
+		uint32_t master = sync->beaconTime;
+
+		if (anchorValid && local - anchorLocal < TIMESYNC_TIMEOUT) {
+			int32_t localSpan = local - anchorLocal;
+			int32_t masterSpan = master - anchorMaster;
+			if (localSpan > 0) {
+				int32_t measured = (int32_t) (((int64_t) (masterSpan
+						- localSpan) * 1000000) / localSpan);
+				if (measured > TIMESYNC_MAX_SKEW) {
+					measured = TIMESYNC_MAX_SKEW;
+				} else if (measured < -TIMESYNC_MAX_SKEW) {
+					measured = -TIMESYNC_MAX_SKEW;
+				}
+				skew += (measured - skew) / 4;
+			}
+		}
+		anchorLocal = local;
+		anchorMaster = master;
+		anchorValid = true;
+		heard[i].tick = 0;
+		return;
+	}
+}
+
+/**
+ * True if timesync_now() can be trusted to match the other devices
+ */
+bool timesync_synced() {
+	return MASTER_DEVICE
+			|| (anchorValid && HAL_GetTick() - anchorLocal < TIMESYNC_TIMEOUT);
+}
+
+/**
+ * Network time in ms: the master's HAL tick, or our estimate of it
+ */
+uint32_t timesync_now() {
+	if (MASTER_DEVICE) {
+		return HAL_GetTick();
+	}
+	__disable_irq();
+	int32_t elapsed = HAL_GetTick() - anchorLocal;
+	uint32_t now = anchorMaster + elapsed + timesync_correction(elapsed);
+	__enable_irq();
+	return now;
+}
+
+/**
+ * Playback target lead ms from now, as the 8 bit code carried in a record
+ */
+uint8_t timesync_target(uint32_t lead) {
+	if (!timesync_synced()) {
+		return TIMESYNC_NO_TARGET;
+	}
+	uint32_t units = (timesync_now() + lead + (1 << TIMESYNC_UNIT_SHIFT) - 1)
+			>> TIMESYNC_UNIT_SHIFT;
+	uint8_t target = units & 0xFF;
+	// one unit late beats being mistaken for "no target"
+	return target == TIMESYNC_NO_TARGET ? target + 1 : target;
+}
+
+/**
+ * Converts a received target to the local tick playback should start at.
+ * Returns false if there is nothing to wait for: no target, not synced, or
+ * the target has already passed.
+ */
+bool timesync_due(uint8_t target, uint32_t *tick) {
+	if (target == TIMESYNC_NO_TARGET || !timesync_synced()) {
+		return false;
+	}
+	uint32_t now = timesync_now();
+	int32_t units = (int8_t) (target - ((now >> TIMESYNC_UNIT_SHIFT) & 0xFF));
+	// the code wraps every 4 s, anything further ahead than a sender would
+	// ever schedule is really a late copy
+	if (units < 0
+			|| units > (TIMESYNC_PLAYBACK_LEAD >> TIMESYNC_UNIT_SHIFT) + 1) {
+		return false;
+	}
+	int32_t wait = (int32_t) ((((now >> TIMESYNC_UNIT_SHIFT) + units)
+			<< TIMESYNC_UNIT_SHIFT) - now);
+	if (wait <= 0) {
+		return false;
+	}
+	*tick = HAL_GetTick() + wait - timesync_correction(wait);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+/**
+ * How much the master's clock gains on ours over elapsed local ms
+ */
+static int32_t timesync_correction(int32_t elapsed) {
+	return (int32_t) (((int64_t) elapsed * skew) / 1000000);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// A slave that has not had a sync sample for this long falls back to playing
+// messages on arrival, in ms.
+#ifndef TIMESYNC_TIMEOUT
+#define TIMESYNC_TIMEOUT 10000
+#endif
+
+// Limit on the estimated clock skew, in ppm. The HSI is good to about 1 %.
+#ifndef TIMESYNC_MAX_SKEW
+#define TIMESYNC_MAX_SKEW 20000
+#endif
+
+// How far ahead of the recording's end the sender schedules playback, in ms.
+// Has to cover the copies, the wait for our slot and a relay hop, and stay
+// below the 4 s span of the 8 bit target.
+#ifndef TIMESYNC_PLAYBACK_LEAD
+#define TIMESYNC_PLAYBACK_LEAD 1000
+#endif
+
+// Playback targets count network time in units of 2^TIMESYNC_UNIT_SHIFT ms.
+#define TIMESYNC_UNIT_SHIFT 4
+
+// Target code meaning "play on arrival", sent while we are not synced.
+#define TIMESYNC_NO_TARGET 0
+
+
+/**
+ * Master clock reading paired with the local tick it was taken at.
+ */
+typedef struct {
+	uint32_t sequenceNumber;
+	uint32_t tick;
+} timesync_stamp_t;
+
+
+/**
+ *  Global Functions
+ */
+void timesync_init();
+void timesync_beaconSent(uint32_t sequenceNumber, uint32_t txTick);
+bool timesync_buildSync(SyncPacket *sync);
+void timesync_beaconHeard(uint32_t sequenceNumber, uint32_t rxTick);
+void timesync_receiveSync(const SyncPacket *sync);
+bool timesync_synced();
+uint32_t timesync_now();
+uint8_t timesync_target(uint32_t lead);
+bool timesync_due(uint8_t target, uint32_t *tick);
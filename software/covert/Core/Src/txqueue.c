@@ -0,0 +1,149 @@
+#include "txqueue.h"
+
+#include <string.h>
+
+// Entries are kept in arrival order; priority is applied when popping.
+static txqueue_entry_t queue[TXQUEUE_SIZE];
+static volatile uint8_t count = 0;
+
+/**
+ * Private Function Definitions
+ */
+static void txqueue_remove(uint8_t index);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Drops everything waiting to be sent
+ */
+void txqueue_init() {
+	count = 0;
+}
+
+/**
+ * Appends a record. When the queue is full the newest record of the lowest
+ * class below this one is shed to make room; returns false if there is none.
+ */
+bool txqueue_push(const Packet *packet, const FrameHeader *header,
+		uint8_t copies) {
+	return txqueue_requeue(packet, header, copies, HAL_GetTick());
+}
+
+/**
+ * Puts a record that was popped but not sent back, keeping the time it was
+ * first queued so the wait can be bounded across attempts
+ */
+bool txqueue_requeue(const Packet *packet, const FrameHeader *header,
+		uint8_t copies, uint32_t queued) {
+	bool pushed = false;
+	uint8_t priority = FRAME_PRIORITY(header->flags);
+
+	__disable_irq();
+	if (count == TXQUEUE_SIZE) {
+		int8_t victim = -1;
+		uint8_t lowest = priority;
+		for (int8_t i = count - 1; i >= 0; i--) {
+			if (FRAME_PRIORITY(queue[i].header.flags) < lowest) {
+				lowest = FRAME_PRIORITY(queue[i].header.flags);
+				victim = i;
+			}
+		}
+		if (victim >= 0) {
+			txqueue_remove(victim);
+		}
+	}
+	if (count < TXQUEUE_SIZE) {
+		txqueue_entry_t *entry = &queue[count];
+		memcpy(&entry->packet, packet, sizeof(Packet));
+		memcpy(&entry->header, header, sizeof(FrameHeader));
+		entry->copies = copies;
+		entry->queued = queued;
+		count++;
+		pushed = true;
+	}
+	__enable_irq();
+
+	return pushed;
+}
+
+bool txqueue_empty() {
+	return count == 0;
+}
+
+/**
+ * Highest class waiting to be sent, or -1 if the queue is empty
+ */
+int8_t txqueue_topPriority() {
+	int8_t top = -1;
+
+	__disable_irq();
+	for (uint8_t i = 0; i < count; i++) {
+		if (FRAME_PRIORITY(queue[i].header.flags) > top) {
+			top = FRAME_PRIORITY(queue[i].header.flags);
+		}
+	}
+	__enable_irq();
+
+	return top;
+}
+
+/**
+ * Takes up to max of the oldest records in the highest waiting class that
+ * are going to the same destination, so they can share one frame. header is
+ * set to that of the first record, copies to the highest repeat count among
+ * them and queued to when the oldest of them was queued.
+ */
+uint8_t txqueue_pop(Packet *packets, uint8_t max, FrameHeader *header,
+		uint8_t *copies, uint32_t *queued) {
+	uint8_t taken = 0;
+	*copies = 0;
+
+	int8_t top = txqueue_topPriority();
+	if (top < 0) {
+		return 0;
+	}
+
+	__disable_irq();
+	bool first = true;
+	for (uint8_t i = 0; i < count && taken < max;) {
+		txqueue_entry_t *entry = &queue[i];
+		if (FRAME_PRIORITY(entry->header.flags) != top
+				|| (!first && entry->header.address != header->address)) {
+			i++;
+			continue;
+		}
+		if (first) {
+			memcpy(header, &entry->header, sizeof(FrameHeader));
+			*queued = entry->queued;
+			first = false;
+		}
+		memcpy(&packets[taken++], &entry->packet, sizeof(Packet));
+		if (entry->copies > *copies) {
+			*copies = entry->copies;
+		}
+		if ((int32_t) (entry->queued - *queued) < 0) {
+			*queued = entry->queued;
+		}
+		txqueue_remove(i);
+	}
+	__enable_irq();
+
+	return taken;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static void txqueue_remove(uint8_t index) {
+	for (uint8_t i = index; i + 1 < count; i++) {
+		queue[i] = queue[i + 1];
+	}
+	count--;
+}
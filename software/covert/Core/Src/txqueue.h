@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+#ifndef TXQUEUE_SIZE
+#define TXQUEUE_SIZE 8
+#endif
+
+// Records coalesced into one radio frame when several are waiting.
+#ifndef AGGREGATE_MAX
+#define AGGREGATE_MAX 4
+#endif
+
+
+/**
+ * A plaintext record waiting for the radio, the header of the frame it has to
+ * go out in, how many times to send it and when it was first queued.
+ */
+typedef struct {
+	Packet packet;
+	FrameHeader header;
+	uint8_t copies;
+	uint32_t queued;
+} txqueue_entry_t;
+
+
+/**
+ *  Global Functions
+ */
+void txqueue_init();
+bool txqueue_push(const Packet *packet, const FrameHeader *header,
+		uint8_t copies);
+bool txqueue_requeue(const Packet *packet, const FrameHeader *header,
+		uint8_t copies, uint32_t queued);
+bool txqueue_empty();
+int8_t txqueue_topPriority();
+uint8_t txqueue_pop(Packet *packets, uint8_t max, FrameHeader *header,
+		uint8_t *copies, uint32_t *queued);
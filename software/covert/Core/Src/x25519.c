@@ -0,0 +1,207 @@
+#include "x25519.h"
+
+#include <string.h>
+
+static const x25519_gf a24 = { 0xDB41, 1 };
+
+/**
+ * Private Function Definitions
+ */
+static void x25519_carry(x25519_gf o);
+static void x25519_select(x25519_gf p, x25519_gf q, int64_t bit);
+static void x25519_unpack(x25519_gf o, const uint8_t *n);
+static void x25519_pack(uint8_t *o, const x25519_gf n);
+static void x25519_add(x25519_gf o, const x25519_gf a, const x25519_gf b);
+static void x25519_sub(x25519_gf o, const x25519_gf a, const x25519_gf b);
+static void x25519_mul(x25519_gf o, const x25519_gf a, const x25519_gf b);
+static void x25519_ladder(x25519_t *ctx, uint8_t bit);
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Public functions
+ */
+
+/**
+ * Sets up scalar * point, with the scalar clamped as X25519 wants. A NULL
+ * point means the base point 9, which gives the public key of a private one.
+ */
+void x25519_start(x25519_t *ctx, const uint8_t *scalar, const uint8_t *point) {
+	uint8_t base[32] = { 9 };
+
+	memcpy(ctx->scalar, scalar, 32);
+	ctx->scalar[0] &= 248;
+	ctx->scalar[31] = (ctx->scalar[31] & 127) | 64;
+
+	x25519_unpack(ctx->x1, point != NULL ? point : base);
+	memcpy(ctx->x3, ctx->x1, sizeof(x25519_gf));
+	memset(ctx->x2, 0, sizeof(x25519_gf));
+	memset(ctx->z2, 0, sizeof(x25519_gf));
+	memset(ctx->z3, 0, sizeof(x25519_gf));
+	ctx->x2[0] = 1;
+	ctx->z3[0] = 1;
+	ctx->step = 0;
+}
+
+/**
+ * Does one step: a ladder step for the next scalar bit, or one squaring of
+ * the inversion of z that follows. Each costs a handful of field
+ * multiplications. Returns true once there is nothing left to do.
+ */
+bool x25519_step(x25519_t *ctx) {
+	if (ctx->step < X25519_LADDER_STEPS) {
+		uint8_t i = X25519_LADDER_STEPS - 1 - ctx->step;
+		x25519_ladder(ctx, (ctx->scalar[i >> 3] >> (i & 7)) & 1);
+	} else if (ctx->step < X25519_STEPS) {
+		// z^(p - 2) by square and multiply, p - 2 has all bits set but 2 and 4
+		uint8_t i = X25519_STEPS - 1 - ctx->step;
+		if (ctx->step == X25519_LADDER_STEPS) {
+			memcpy(ctx->inverse, ctx->z2, sizeof(x25519_gf));
+		}
+		x25519_mul(ctx->inverse, ctx->inverse, ctx->inverse);
+		if (i != 2 && i != 4) {
+			x25519_mul(ctx->inverse, ctx->inverse, ctx->z2);
+		}
+	} else {
+		return true;
+	}
+	ctx->step++;
+	return ctx->step >= X25519_STEPS;
+}
+
+/**
+ * Runs whatever steps are left and writes the resulting u coordinate
+ */
+void x25519_finish(x25519_t *ctx, uint8_t *out) {
+	while (!x25519_step(ctx)) {
+	}
+	x25519_mul(ctx->x2, ctx->x2, ctx->inverse);
+	x25519_pack(out, ctx->x2);
+	// the scalar is a private key
+	memset(ctx->scalar, 0, sizeof(ctx->scalar));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Private Functions
+ */
+
+static void x25519_carry(x25519_gf o) {
+	for (uint8_t i = 0; i < 16; i++) {
+		o[i] += (int64_t) 1 << 16;
+		int64_t c = o[i] >> 16;
+		o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+		o[i] -= c << 16;
+	}
+}
+
+/**
+ * Swaps p and q if bit is set, without branching on it
+ */
+static void x25519_select(x25519_gf p, x25519_gf q, int64_t bit) {
+	int64_t mask = ~(bit - 1);
+
+	for (uint8_t i = 0; i < 16; i++) {
+		int64_t t = mask & (p[i] ^ q[i]);
+		p[i] ^= t;
+		q[i] ^= t;
+	}
+}
+
+static void x25519_unpack(x25519_gf o, const uint8_t *n) {
+	for (uint8_t i = 0; i < 16; i++) {
+		o[i] = n[2 * i] + ((int64_t) n[2 * i + 1] << 8);
+	}
+	o[15] &= 0x7FFF;
+}
+
+/**
+ * Fully reduces mod 2^255 - 19 and writes little endian bytes
+ */
+static void x25519_pack(uint8_t *o, const x25519_gf n) {
+	x25519_gf m;
+	x25519_gf t;
+
+	memcpy(t, n, sizeof(x25519_gf));
+	x25519_carry(t);
+	x25519_carry(t);
+	x25519_carry(t);
+	for (uint8_t j = 0; j < 2; j++) {
+		m[0] = t[0] - 0xFFED;
+		for (uint8_t i = 1; i < 15; i++) {
+			m[i] = t[i] - 0xFFFF - ((m[i - 1] >> 16) & 1);
+			m[i - 1] &= 0xFFFF;
+		}
+		m[15] = t[15] - 0x7FFF - ((m[14] >> 16) & 1);
+		int64_t borrow = (m[15] >> 16) & 1;
+		m[14] &= 0xFFFF;
+		x25519_select(t, m, 1 - borrow);
+	}
+	for (uint8_t i = 0; i < 16; i++) {
+		o[2 * i] = t[i] & 0xFF;
+		o[2 * i + 1] = t[i] >> 8;
+	}
+}
+
+static void x25519_add(x25519_gf o, const x25519_gf a, const x25519_gf b) {
+	for (uint8_t i = 0; i < 16; i++) {
+		o[i] = a[i] + b[i];
+	}
+}
+
+static void x25519_sub(x25519_gf o, const x25519_gf a, const x25519_gf b) {
+	for (uint8_t i = 0; i < 16; i++) {
+		o[i] = a[i] - b[i];
+	}
+}
+
+/**
+ * Schoolbook product with the top half folded back in, 2^256 = 38
+ */
+static void x25519_mul(x25519_gf o, const x25519_gf a, const x25519_gf b) {
+	int64_t t[31] = { 0 };
+
+	for (uint8_t i = 0; i < 16; i++) {
+		for (uint8_t j = 0; j < 16; j++) {
+			t[i + j] += a[i] * b[j];
+		}
+	}
+	for (uint8_t i = 0; i < 15; i++) {
+		t[i] += 38 * t[i + 16];
+	}
+	memcpy(o, t, sizeof(x25519_gf));
+	x25519_carry(o);
+	x25519_carry(o);
+}
+
+/**
+ * One combined double and differential add, RFC 7748 section 5
+ */
+static void x25519_ladder(x25519_t *ctx, uint8_t bit) {
+	x25519_gf e;
+	x25519_gf f;
+
+	x25519_select(ctx->x2, ctx->x3, bit);
+	x25519_select(ctx->z2, ctx->z3, bit);
+	x25519_add(e, ctx->x2, ctx->z2);
+	x25519_sub(ctx->x2, ctx->x2, ctx->z2);
+	x25519_add(ctx->z2, ctx->x3, ctx->z3);
+	x25519_sub(ctx->x3, ctx->x3, ctx->z3);
+	x25519_mul(ctx->z3, e, e);
+	x25519_mul(f, ctx->x2, ctx->x2);
+	x25519_mul(ctx->x2, ctx->z2, ctx->x2);
+	x25519_mul(ctx->z2, ctx->x3, e);
+	x25519_add(e, ctx->x2, ctx->z2);
+	x25519_sub(ctx->x2, ctx->x2, ctx->z2);
+	x25519_mul(ctx->x3, ctx->x2, ctx->x2);
+	x25519_sub(ctx->z2, ctx->z3, f);
+	x25519_mul(ctx->x2, ctx->z2, a24);
+	x25519_add(ctx->x2, ctx->x2, ctx->z3);
+	x25519_mul(ctx->z2, ctx->z2, ctx->x2);
+	x25519_mul(ctx->x2, ctx->z3, f);
+	x25519_mul(ctx->z3, ctx->x3, ctx->x1);
+	x25519_mul(ctx->x3, e, e);
+	x25519_select(ctx->x2, ctx->x3, bit);
+	x25519_select(ctx->z2, ctx->z3, bit);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include "main.h"
+
+// X25519 (RFC 7748) as a Montgomery ladder that runs a step at a time, so a
+// scalar multiplication can be spread over the main loop. Field elements are
+// sixteen 16 bit limbs held in 64 bit words.
+
+// Ladder steps, one per scalar bit, then the steps of the final inversion.
+#define X25519_LADDER_STEPS 255
+#define X25519_INVERT_STEPS 254
+#define X25519_STEPS (X25519_LADDER_STEPS + X25519_INVERT_STEPS)
+
+
+typedef int64_t x25519_gf[16];
+
+/**
+ * A scalar multiplication in progress.
+ */
+typedef struct {
+	uint8_t scalar[32];
+	x25519_gf x1;
+	x25519_gf x2;
+	x25519_gf z2;
+	x25519_gf x3;
+	x25519_gf z3;
+	x25519_gf inverse;
+	uint16_t step;
+} x25519_t;
+
+
+/**
+ *  Global Functions
+ */
+void x25519_start(x25519_t *ctx, const uint8_t *scalar, const uint8_t *point);
+bool x25519_step(x25519_t *ctx);
+void x25519_finish(x25519_t *ctx, uint8_t *out);
@@ -4,38 +4,127 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../Core/Src/ack.c \
+../Core/Src/airtime.c \
+../Core/Src/bulk.c \
+../Core/Src/codebook.c \
+../Core/Src/config.c \
+../Core/Src/entropy.c \
+../Core/Src/fec.c \
+../Core/Src/gcm.c \
+../Core/Src/groupkey.c \
+../Core/Src/kdf.c \
+../Core/Src/keyslot.c \
+../Core/Src/link.c \
+../Core/Src/mac.c \
 ../Core/Src/main.c \
+../Core/Src/pairkey.c \
+../Core/Src/relay.c \
 ../Core/Src/rfm95.c \
+../Core/Src/saf.c \
 ../Core/Src/stm32g0xx_hal_msp.c \
 ../Core/Src/stm32g0xx_it.c \
 ../Core/Src/syscalls.c \
 ../Core/Src/sysmem.c \
-../Core/Src/system_stm32g0xx.c 
+../Core/Src/system_stm32g0xx.c \
+../Core/Src/timesync.c \
+../Core/Src/txqueue.c \
+../Core/Src/x25519.c 
 
 OBJS += \
+./Core/Src/ack.o \
+./Core/Src/airtime.o \
+./Core/Src/bulk.o \
+./Core/Src/codebook.o \
+./Core/Src/config.o \
+./Core/Src/entropy.o \
+./Core/Src/fec.o \
+./Core/Src/gcm.o \
+./Core/Src/groupkey.o \
+./Core/Src/kdf.o \
+./Core/Src/keyslot.o \
+./Core/Src/link.o \
+./Core/Src/mac.o \
 ./Core/Src/main.o \
+./Core/Src/pairkey.o \
+./Core/Src/relay.o \
 ./Core/Src/rfm95.o \
+./Core/Src/saf.o \
 ./Core/Src/stm32g0xx_hal_msp.o \
 ./Core/Src/stm32g0xx_it.o \
 ./Core/Src/syscalls.o \
 ./Core/Src/sysmem.o \
-./Core/Src/system_stm32g0xx.o 
+./Core/Src/system_stm32g0xx.o \
+./Core/Src/timesync.o \
+./Core/Src/txqueue.o \
+./Core/Src/x25519.o 
 
 C_DEPS += \
+./Core/Src/ack.d \
+./Core/Src/airtime.d \
+./Core/Src/bulk.d \
+./Core/Src/codebook.d \
+./Core/Src/config.d \
+./Core/Src/entropy.d \
+./Core/Src/fec.d \
+./Core/Src/gcm.d \
+./Core/Src/groupkey.d \
+./Core/Src/kdf.d \
+./Core/Src/keyslot.d \
+./Core/Src/link.d \
+./Core/Src/mac.d \
 ./Core/Src/main.d \
+./Core/Src/pairkey.d \
+./Core/Src/relay.d \
 ./Core/Src/rfm95.d \
+./Core/Src/saf.d \
 ./Core/Src/stm32g0xx_hal_msp.d \
 ./Core/Src/stm32g0xx_it.d \
 ./Core/Src/syscalls.d \
 ./Core/Src/sysmem.d \
-./Core/Src/system_stm32g0xx.d 
+./Core/Src/system_stm32g0xx.d \
+./Core/Src/timesync.d \
+./Core/Src/txqueue.d \
+./Core/Src/x25519.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
+Core/Src/ack.o: ../Core/Src/ack.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/ack.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/airtime.o: ../Core/Src/airtime.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/airtime.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/bulk.o: ../Core/Src/bulk.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/bulk.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/codebook.o: ../Core/Src/codebook.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/codebook.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/config.o: ../Core/Src/config.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/config.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/entropy.o: ../Core/Src/entropy.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/entropy.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/fec.o: ../Core/Src/fec.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/fec.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/gcm.o: ../Core/Src/gcm.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/gcm.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/groupkey.o: ../Core/Src/groupkey.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/groupkey.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/kdf.o: ../Core/Src/kdf.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/kdf.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/keyslot.o: ../Core/Src/keyslot.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/keyslot.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/link.o: ../Core/Src/link.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/link.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/mac.o: ../Core/Src/mac.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/mac.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
 Core/Src/main.o: ../Core/Src/main.c
 	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/main.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/pairkey.o: ../Core/Src/pairkey.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/pairkey.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/relay.o: ../Core/Src/relay.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/relay.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
 Core/Src/rfm95.o: ../Core/Src/rfm95.c
 	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/rfm95.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/saf.o: ../Core/Src/saf.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/saf.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
 Core/Src/stm32g0xx_hal_msp.o: ../Core/Src/stm32g0xx_hal_msp.c
 	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/stm32g0xx_hal_msp.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
 Core/Src/stm32g0xx_it.o: ../Core/Src/stm32g0xx_it.c
@@ -46,4 +135,10 @@ Core/Src/sysmem.o: ../Core/Src/sysmem.c
 	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/sysmem.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
 Core/Src/system_stm32g0xx.o: ../Core/Src/system_stm32g0xx.c
 	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/system_stm32g0xx.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/timesync.o: ../Core/Src/timesync.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/timesync.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/txqueue.o: ../Core/Src/txqueue.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/txqueue.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+Core/Src/x25519.o: ../Core/Src/x25519.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m0plus -std=gnu11 -g3 -DUSE_HAL_DRIVER -DSTM32G081xx -DDEBUG -c -I../Core/Inc -I/home/braedensmith/Downloads/patch_x-cube-cryptolib-3.1.3/STM32CubeExpansion_Crypto_V3.1.0/STM32G0/Middlewares/ST/STM32_Cryptographic/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc -I../Drivers/STM32G0xx_HAL_Driver/Inc/Legacy -I../Drivers/CMSIS/Device/ST/STM32G0xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"Core/Src/x25519.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
 